@@ -0,0 +1,91 @@
+#ifndef ARENA_ALLOCATOR_H
+#define ARENA_ALLOCATOR_H
+
+#include <ArduinoJson.h>
+
+// Bump allocator over a static buffer: the JSON documents using it never touch the heap.
+// Memory is only released all at once by reset(). Each block is preceded by its size,
+// so that a block moved by reallocate() copies only what it holds.
+template <size_t SIZE>
+class ArenaAllocator : public ArduinoJson::Allocator
+{
+    public:
+        void *allocate(size_t size) override
+        {
+            size = align(size);
+            if (used + HEADER_SIZE + size > SIZE)
+            {
+                return nullptr;
+            }
+
+            *(size_t *)&arena[used] = size;
+            last = &arena[used + HEADER_SIZE];
+            used += HEADER_SIZE + size;
+            return last;
+        }
+
+        void deallocate(void *) override
+        {
+        }
+
+        void *reallocate(void *ptr, size_t size) override
+        {
+            if (ptr == nullptr)
+            {
+                return allocate(size);
+            }
+
+            size_t &blockSize = *(size_t *)((uint8_t *)ptr - HEADER_SIZE);
+            size = align(size);
+
+            // The last block grows or shrinks in place, the others only shrink
+            if (ptr == last)
+            {
+                size_t offset = (uint8_t *)ptr - arena;
+                if (offset + size > SIZE)
+                {
+                    return nullptr;
+                }
+                used = offset + size;
+                blockSize = size;
+                return ptr;
+            }
+            if (size <= blockSize)
+            {
+                return ptr;
+            }
+
+            size_t oldSize = blockSize;
+            void *moved = allocate(size);
+            if (moved)
+            {
+                memcpy(moved, ptr, oldSize);
+            }
+            return moved;
+        }
+
+        void reset()
+        {
+            used = 0;
+            last = nullptr;
+        }
+
+        size_t peak() const
+        {
+            return used;
+        }
+
+    private:
+        static constexpr size_t HEADER_SIZE = 8;    // keeps the blocks 8 bytes aligned
+
+        static size_t align(size_t size)
+        {
+            return (size + 7) & ~(size_t)7;
+        }
+
+        alignas(8) uint8_t arena[SIZE];
+        size_t   used = 0;
+        uint8_t *last = nullptr;
+};
+
+#endif
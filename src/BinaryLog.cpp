@@ -0,0 +1,199 @@
+#include "BinaryLog.h"
+#include "MultiPrint.h"
+
+/**************\
+ * Binary log *
+\**************/
+
+static Print *binaryLogOutput = nullptr;
+static uint32_t lastRecordTime = 0;     // ms, the first record of a wake counts from the boot
+
+// Prints a Printable argument into a string argument
+class StringPrint : public Print
+{
+    public:
+        char buffer[32];
+        size_t length = 0;
+
+        size_t write(uint8_t c) override
+        {
+            if (length >= sizeof(buffer))
+            {
+                return 0;
+            }
+            buffer[length++] = c;
+            return 1;
+        }
+};
+
+BinaryLogRecord::BinaryLogRecord(uint8_t level, uint32_t id)
+{
+    uint32_t now = millis();
+    uint32_t delta = now - __atomic_exchange_n(&lastRecordTime, now, __ATOMIC_RELAXED);
+
+    put(level);
+    for (uint8_t i = 0; i < sizeof(id); i++)
+    {
+        put((uint8_t)(id >> (8 * i)));
+    }
+    putVarint(delta);
+}
+
+// A format which is not in flash is sent as text
+BinaryLogRecord::BinaryLogRecord(uint8_t level, const void *format)
+    : BinaryLogRecord(level, BINARY_LOG_IN_FLASH(format) ? (uint32_t)(uintptr_t)format : (uint32_t)BINARY_LOG_TEXT)
+{
+    if (!BINARY_LOG_IN_FLASH(format))
+    {
+        add((const char *)format);
+    }
+}
+
+bool BinaryLogRecord::put(uint8_t value)
+{
+    if (length >= sizeof(data))
+    {
+        return false;
+    }
+    data[length++] = value;
+    return true;
+}
+
+bool BinaryLogRecord::putVarint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        if (!put((uint8_t)(value | 0x80)))
+        {
+            return false;
+        }
+        value >>= 7;
+    }
+    return put((uint8_t)value);
+}
+
+// An argument which does not fit is left out with all the next ones
+void BinaryLogRecord::putSigned(int64_t value)
+{
+    size_t start = length;
+    if (full || !put(BINARY_LOG_SIGNED) || !putVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63)))
+    {
+        length = start;
+        full = true;
+    }
+}
+
+void BinaryLogRecord::putUnsigned(uint64_t value)
+{
+    size_t start = length;
+    if (full || !put(BINARY_LOG_UNSIGNED) || !putVarint(value))
+    {
+        length = start;
+        full = true;
+    }
+}
+
+void BinaryLogRecord::putFloat(float value)
+{
+    size_t start = length;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    bool ok = !full && put(BINARY_LOG_FLOAT);
+    for (uint8_t i = 0; ok && i < sizeof(bits); i++)
+    {
+        ok = put((uint8_t)(bits >> (8 * i)));
+    }
+    if (!ok)
+    {
+        length = start;
+        full = true;
+    }
+}
+
+void BinaryLogRecord::putString(const char *value, size_t size)
+{
+    size_t start = length;
+    if (full || !put(BINARY_LOG_STRING) || !putVarint(size) || length + size > sizeof(data))
+    {
+        length = start;
+        full = true;
+        return;
+    }
+    memcpy(&data[length], value, size);
+    length += size;
+}
+
+void BinaryLogRecord::add(const char *value)
+{
+    value = value != nullptr ? value : "(null)";
+    putString(value, strlen(value));
+}
+
+void BinaryLogRecord::add(const __FlashStringHelper *value)
+{
+    add((const char *)value);
+}
+
+void BinaryLogRecord::add(const String &value)
+{
+    putString(value.c_str(), value.length());
+}
+
+void BinaryLogRecord::add(const Printable &value)
+{
+    StringPrint text;
+    value.printTo(text);
+    putString(text.buffer, text.length);
+}
+
+void BinaryLogRecord::add(const void *value)
+{
+    putUnsigned((uintptr_t)value);
+}
+
+void BinaryLogRecord::send()
+{
+    if (binaryLogOutput == nullptr)
+    {
+        return;
+    }
+
+    uint8_t frame[2 + 2 * BINARY_LOG_MAX_RECORD];
+    size_t size = 0;
+
+    frame[size++] = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t value = data[i];
+        if (value == 0 || value == '\n' || value == BINARY_LOG_ESCAPE)
+        {
+            frame[size++] = BINARY_LOG_ESCAPE;
+            value ^= 0x20;
+        }
+        frame[size++] = value;
+    }
+    frame[size++] = '\n';
+
+    // The outputs of a MultiPrint filter the record on its level
+    if (binaryLogOutput == MultiPrint::instance)
+    {
+        MultiPrint::instance->setRecordLevel(data[0]);
+    }
+    binaryLogOutput->write(frame, size);
+}
+
+void binaryLogBegin(Print *output)
+{
+    binaryLogOutput = output;
+}
+
+// Gives the decoder the run number and the time since the boot
+void binaryLogWake(uint32_t run)
+{
+#if LOG_FORMAT_BINARY
+    BinaryLogRecord record(LOG_LEVEL_FATAL, (uint32_t)BINARY_LOG_WAKE);
+    record.add(run);
+    record.send();
+#endif
+}
@@ -0,0 +1,97 @@
+#ifndef BINARY_LOG_H
+#define BINARY_LOG_H
+
+#include "Arduino.h"
+#include <type_traits>
+#include <soc/soc.h>
+
+// Log records in the style of defmt: the device writes the address of the
+// format string and the raw arguments, without formatting anything, and
+// tools/logdecode.py rebuilds the text from the firmware ELF. Enable it in
+// build_flags with -DLOG_FORMAT_BINARY=1
+#ifndef LOG_FORMAT_BINARY
+#define LOG_FORMAT_BINARY 0
+#endif
+
+// Format strings read from the flash by the decoder
+#ifndef BINARY_LOG_IN_FLASH
+#define BINARY_LOG_IN_FLASH(p) ((uintptr_t)(p) >= SOC_DROM_LOW && (uintptr_t)(p) < SOC_DROM_HIGH)
+#endif
+
+#define BINARY_LOG_MAX_RECORD 128       // bytes before escaping, the arguments past it are left out
+
+// Format ids below the flash addresses
+#define BINARY_LOG_TEXT 0               // the format is the first argument (not in flash)
+#define BINARY_LOG_WAKE 1               // first record of a wake, the argument is the run number
+
+// Argument tags
+#define BINARY_LOG_SIGNED   'i'         // zigzag varint
+#define BINARY_LOG_UNSIGNED 'u'         // varint
+#define BINARY_LOG_FLOAT    'f'         // float, little endian
+#define BINARY_LOG_STRING   's'         // varint length, then the bytes
+
+// Frame: 0x00, escaped record, '\n'. 0x00, '\n' and 0x1B are escaped as
+// 0x1B, byte ^ 0x20, so the frames pass through the line based outputs.
+#define BINARY_LOG_ESCAPE 0x1B
+
+// One record: level, format id (uint32), time since the previous record in ms
+// (varint), then one tagged value per argument
+class BinaryLogRecord
+{
+    private:
+        uint8_t data[BINARY_LOG_MAX_RECORD];
+        size_t length = 0;
+        bool full = false;
+
+        bool put(uint8_t value);
+        bool putVarint(uint64_t value);
+        void putSigned(int64_t value);
+        void putUnsigned(uint64_t value);
+        void putFloat(float value);
+        void putString(const char *value, size_t size);
+
+    public:
+        BinaryLogRecord(uint8_t level, uint32_t id);
+        BinaryLogRecord(uint8_t level, const void *format);
+
+        template <class T>
+        void add(T value, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type * = nullptr)
+        {
+            putSigned(value);
+        }
+        template <class T>
+        void add(T value, typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type * = nullptr)
+        {
+            putUnsigned(value);
+        }
+        template <class T>
+        void add(T value, typename std::enable_if<std::is_enum<T>::value>::type * = nullptr)
+        {
+            putSigned((int64_t)value);
+        }
+        template <class T>
+        void add(T value, typename std::enable_if<std::is_floating_point<T>::value>::type * = nullptr)
+        {
+            putFloat(value);
+        }
+        void add(const char *value);
+        void add(const __FlashStringHelper *value);
+        void add(const String &value);
+        void add(const Printable &value);
+        void add(const void *value);
+
+        void send();
+};
+
+void binaryLogBegin(Print *output);
+void binaryLogWake(uint32_t run);
+
+template <class T, typename... Args> void binaryLog(uint8_t level, T format, Args... args)
+{
+    BinaryLogRecord record(level, (const void *)format);
+    int unused[] = {0, (record.add(args), 0)...};
+    (void)unused;
+    record.send();
+}
+
+#endif
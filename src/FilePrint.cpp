@@ -5,9 +5,68 @@ String FilePrint::getLastLogFileName() {
     return lastLogFileName;
 }
 
-FilePrint::FilePrint() {
+// Name of the slot holding a log sequence
+String FilePrint::slotName(uint32_t seq) {
+    char buffer[20];
+    snprintf(buffer, sizeof(buffer), "/log%03u.txt", (unsigned)(seq % MAX_LOG_FILE_NUMBER));
+    return String(buffer);
+}
+
+// Sequence of the current log file, -1 if there is no index yet
+long FilePrint::readIndex() {
+    File index = LittleFS.open(LOG_INDEX_FILE, "r");
+    if (!index) {
+        return -1;
+    }
+
+    char buffer[12];
+    size_t length = index.readBytes(buffer, sizeof(buffer) - 1);
+    index.close();
+    buffer[length] = 0;
+
+    if (length == 0 || !isDigit(buffer[0])) {
+        Log.errorln("Log index corrupted");
+        return -1;
+    }
+    return strtoul(buffer, NULL, 10);
+}
+
+bool FilePrint::writeIndex(uint32_t seq) {
+    File index = LittleFS.open(LOG_INDEX_FILE, "w");
+    if (!index) {
+        return false;
+    }
+    index.println(seq);
+    index.close();
+    return true;
+}
+
+// Without an index (first start, older firmware), the newest log file gives
+// the sequence. The files beyond the slots are deleted.
+bool FilePrint::scanLogFile(const FileEntry &entry, void *context) {
+    FilePrint *self = (FilePrint *)context;
+    Log.verboseln("  FILE: %s, SIZE: %d", entry.name, entry.size);
+
+    if (strncmp(entry.name, "log", 3) == 0 && isDigit(entry.name[3]) && entry.size > 0){
+        int seq = atoi(&entry.name[3]);
+        if (seq >= MAX_LOG_FILE_NUMBER) {
+            Log.errorln("Too many log files. Deleting %s", entry.name);
+            LittleFS.remove(String("/") + entry.name);
+        } else if (self->lastSeq < seq){
+            self->lastSeq = seq;
+        }
+    }
+    return true;
+}
+
+// The log files are slots written round-robin. The index file holds the
+// sequence of the current one, so a boot reads and writes one small file.
+bool FilePrint::begin() {
+    if (initialized) {
+        return true;
+    }
+
     Log.traceln("Mounting LittleFS partition");
-    esp_err_t err;
     
     if (!LittleFS.begin(false, BASE_PATH, MAX_OPEN_FILE, PARTITION_LABEL)){
         Log.errorln("LittleFS Mount Failed. Formatting");
@@ -15,112 +74,79 @@ FilePrint::FilePrint() {
 
         if (err != ESP_OK){
             Log.errorln("LittleFS formatting failed");
-            return;
+            return false;
         }
     }
-    File root = LittleFS.open("/");
-    Log.traceln(F("List root file folder"));
-
-    if(!root){
-        Log.errorln("Failed to open directory");
-        return;
-    }
 
-    if(!root.isDirectory()){
-        Log.errorln("\"/\" is not a directory");
-        return;
-    }
-    
-    int lastSeq = -1;
-
-    root.rewindDirectory();
-    String nextFileName = root.getNextFileName();
-    while (nextFileName != "") {
-        File nextFile = LittleFS.open(nextFileName);
-        uint16_t nextFileSize = nextFile.size();
-        nextFile.close();
-        Log.verboseln("  FILE: %s, SIZE: %d", nextFileName, nextFileSize);
-
-        if (nextFileName.startsWith("/log") && nextFileSize > 0){
-            String seq = nextFileName.substring(4, nextFileName.lastIndexOf("."));
-            if (lastSeq < seq.toInt()){
-                lastSeq = seq.toInt();
-                lastLogFileName = nextFileName;
-            }
-            if (lastSeq >= MAX_LOG_FILE_NUMBER) {
-                Log.errorln("Too many log files. Deleting %s", nextFileName);
-                LittleFS.remove("/" + nextFileName);
-            }
+    lastSeq = readIndex();
+    if (lastSeq < 0) {
+        Log.traceln(F("No log index. List root file folder"));
+        if (listDir("/", scanLogFile, this) < 0){
+            Log.errorln("Failed to open directory");
+            return false;
         }
-        nextFileName = root.getNextFileName();
     }
-    Log.traceln("Last log sequence: %d", lastSeq);
-    
+    Log.traceln("Last log sequence: %l", lastSeq);
 
-    char buffer [20];
-    if (lastSeq >= MAX_LOG_FILE_NUMBER - 1) {
-        Log.verboseln("Rotating log files");
-        
-        // Delete the oldest log file
-        if (LittleFS.exists("/log000.txt")){
-            Log.verboseln("Deleting oldest log file");
-            if (LittleFS.remove("/log000.txt")){
-                Log.verboseln("/log000.txt file deleted");
-            } else {
-                Log.errorln("/log000.txt delete failed");
-            }
-        }
-        String filename = String(buffer);
-
-        // Shifting remaining files
-        int nextFile = 1;
-        for (int i = 1; i < MAX_LOG_FILE_NUMBER ; i++){
-            snprintf(buffer, sizeof(buffer), "/log%03d.txt", i);
-            String filename = String(buffer);
-
-            if (!LittleFS.exists(filename)){
-                nextFile++;
-                lastSeq--;
-                continue;
-            }
-
-            snprintf(buffer, sizeof(buffer), "/log%03d.txt", i - nextFile);
-            String newFilename = String(buffer);
-            if (LittleFS.rename(filename, newFilename)){
-                Log.verboseln("%s file renamed to %s", filename, newFilename);
-            } else {
-                Log.errorln("%s rename failed", filename);
-            }
-        }
+    if (lastSeq >= 0) {
+        lastLogFileName = slotName(lastSeq);
     }
 
-    // Prepare writing next log file
+    // Prepare writing next log file, over the oldest one
     lastSeq++;
-
-    if (lastSeq >= MAX_LOG_FILE_NUMBER) {
-        lastSeq = MAX_LOG_FILE_NUMBER - 1;
+    if (!writeIndex(lastSeq)) {
+        Log.errorln("Failed to write the log index");
     }
 
-    snprintf(buffer, sizeof(buffer), "/log%03d.txt", lastSeq);
-    String path = String(buffer);
+    String path = slotName(lastSeq);
     Log.noticeln("Opening log file for writing: %s", path);
     logFile = LittleFS.open(path, "w");
     if (!logFile){
         Log.errorln("Failed to open log file for writing: %s", path);
-        return;
+        return false;
     }
 
-    logFile.println("# Log File");
-
     initialized = true;
+    println("# Log File");
+    return true;
+}
+
+// Writes the buffered bytes to the file
+bool FilePrint::writeBuffer() {
+    if (used == 0) {
+        return true;
+    }
+
+    size_t count = logFile.write(_buffer, used);
+    bytesWritten += count;
+    writes++;
+    bool ok = count == used;
+    used = 0;
+    return ok;
 }
 
+// The fragments of the lines are gathered in RAM. The buffer is written when
+// the file reaches the next multiple of its size, so that the writes cover
+// whole flash pages.
 size_t FilePrint::write(const uint8_t * buffer, size_t size) {
+    // Not logged: the error would come back here through the log
     if (!initialized) {
-        Log.errorln("FilePrint not initialized");
         return 0;
-    } 
-    return logFile.write(buffer, size);
+    }
+
+    size_t done = 0;
+    while (done < size) {
+        size_t limit = FILE_PRINT_BUFFER_SIZE - bytesWritten % FILE_PRINT_BUFFER_SIZE;
+        size_t count = min(size - done, limit - used);
+        memcpy(&_buffer[used], &buffer[done], count);
+        used += count;
+        done += count;
+
+        if (used == limit) {
+            writeBuffer();
+        }
+    }
+    return size;
 }
 
 size_t FilePrint::write(uint8_t c) {
@@ -132,9 +158,26 @@ void FilePrint::close() {
         Log.errorln("FilePrint not initialized");
         return;
     }
-    logFile.println("# End of Log File");
+    println("# End of Log File");
+    writeBuffer();
     logFile.flush();
-    Log.noticeln("Closing log file. It is now %d byte", logFile.size());
+    Log.noticeln("Closing log file. It is now %d byte (%l bytes in %l writes)", logFile.size(), bytesWritten, writes);
     logFile.close();
     initialized = false;
 }
+
+void FilePrint::flush() {
+    if (!initialized) {
+        return;
+    }
+    writeBuffer();
+    logFile.flush();
+}
+
+uint32_t FilePrint::getBytesWritten() {
+    return bytesWritten;
+}
+
+uint32_t FilePrint::getWrites() {
+    return writes;
+}
@@ -4,26 +4,47 @@
 #include <cstddef>
 #include <Print.h>
 #include <LittleFS.h>
-#include <ArduinoLog.h>
+#include "LogFloor.h"
 #include "Arduino.h"
 #include "global_vars.h"
+#include "files.h"
 
+#define FILE_PRINT_BUFFER_SIZE 512     // bytes, a multiple of the LittleFS page size (256)
+
+// Writes the log to the current log file slot, through a RAM buffer
 class FilePrint : public Print
 {
     private:
         File logFile;
         bool initialized = false;
+        uint8_t _buffer[FILE_PRINT_BUFFER_SIZE];
+        size_t used = 0;
+        uint32_t bytesWritten = 0;      // on this wake
+        uint32_t writes = 0;            // writes to the file system on this wake
         String lastLogFileName = "";
+        long lastSeq = -1;              // sequence of the current log file
+
+        static String slotName(uint32_t seq);
+        static long readIndex();
+        static bool writeIndex(uint32_t seq);
+        static bool scanLogFile(const FileEntry &entry, void *context);
+        bool writeBuffer();
 
     public:
-        FilePrint();
+        // Mounts LittleFS and opens the next log file slot, once per wake
+        bool begin();
 
         size_t write(const uint8_t * buffer, size_t size) override;
         size_t write(uint8_t c) override;
 
         String getLastLogFileName();
+        uint32_t getBytesWritten();
+        uint32_t getWrites();
 
+        void flush() override;
         void close();
 };
 
+extern FilePrint fileLog;
+
 #endif
@@ -0,0 +1,68 @@
+#ifndef LOG_FLOOR_H
+#define LOG_FLOOR_H
+
+#include <ArduinoLog.h>
+#include "BinaryLog.h"
+
+// Most verbose level compiled in. The calls above it are removed from the
+// binary with their format strings, whatever the runtime levels. Set it in
+// build_flags, e.g. -DLOG_LEVEL_FLOOR=LOG_LEVEL_NOTICE
+#ifndef LOG_LEVEL_FLOOR
+#define LOG_LEVEL_FLOOR LOG_LEVEL_VERBOSE
+#endif
+
+#if LOG_FORMAT_BINARY
+// The device does not format the records
+#define LOG_FLOOR_PRINT(level, method) if (level <= Log.getLevel()) binaryLog(level, msg, args...)
+#else
+#define LOG_FLOOR_PRINT(level, method) Log.method(msg, args...)
+#endif
+
+// Same interface as the ArduinoLog calls used in this project. The level test
+// is a constant, so the compiler drops the whole call when it is false.
+class FlooredLogging
+{
+    public:
+        void begin(int level, Print *output, bool showLevel = true)
+        {
+            Log.begin(level, output, showLevel);
+            binaryLogBegin(output);
+        }
+        void setLevel(int level) { Log.setLevel(level); }
+        int getLevel() { return Log.getLevel(); }
+        void setPrefix(printfunction f) { Log.setPrefix(f); }
+
+        template <class T, typename... Args> void fatalln(T msg, Args... args)
+        {
+            if (LOG_LEVEL_FLOOR >= LOG_LEVEL_FATAL) LOG_FLOOR_PRINT(LOG_LEVEL_FATAL, fatalln);
+        }
+        template <class T, typename... Args> void errorln(T msg, Args... args)
+        {
+            if (LOG_LEVEL_FLOOR >= LOG_LEVEL_ERROR) LOG_FLOOR_PRINT(LOG_LEVEL_ERROR, errorln);
+        }
+        template <class T, typename... Args> void warningln(T msg, Args... args)
+        {
+            if (LOG_LEVEL_FLOOR >= LOG_LEVEL_WARNING) LOG_FLOOR_PRINT(LOG_LEVEL_WARNING, warningln);
+        }
+        template <class T, typename... Args> void noticeln(T msg, Args... args)
+        {
+            if (LOG_LEVEL_FLOOR >= LOG_LEVEL_NOTICE) LOG_FLOOR_PRINT(LOG_LEVEL_NOTICE, noticeln);
+        }
+        template <class T, typename... Args> void traceln(T msg, Args... args)
+        {
+            if (LOG_LEVEL_FLOOR >= LOG_LEVEL_TRACE) LOG_FLOOR_PRINT(LOG_LEVEL_TRACE, traceln);
+        }
+        template <class T, typename... Args> void verboseln(T msg, Args... args)
+        {
+            if (LOG_LEVEL_FLOOR >= LOG_LEVEL_VERBOSE) LOG_FLOOR_PRINT(LOG_LEVEL_VERBOSE, verboseln);
+        }
+};
+
+#undef LOG_FLOOR_PRINT
+
+static FlooredLogging flooredLog __attribute__((unused));
+
+// From here on, Log.xxxln() goes through the floor
+#define Log flooredLog
+
+#endif
@@ -4,10 +4,13 @@ MultiPrint *MultiPrint::instance = nullptr;
 
 MultiPrint::MultiPrint()
 {
-  output = new Print *[4];
-  for (int i = 0; i < sizeof(output); i++)
+  for (int i = 0; i < MULTI_PRINT_MAX_OUTPUTS; i++)
   {
     output[i] = nullptr;
+    policy[i] = LOG_SINK_BLOCK;
+    outputLevel[i] = nullptr;
+    flushLevel[i] = LOG_LEVEL_SILENT;
+    outputDropped[i] = 0;
   }
   instance = this;
   xMutex = xSemaphoreCreateMutex();
@@ -22,19 +25,168 @@ MultiPrint::~MultiPrint()
   //esp_log_set_vprintf(nullptr);
 }
 
-size_t MultiPrint::write(const uint8_t *buffer, size_t size)
+// Starts the dispatcher task. Until then, the writers write to the outputs themselves.
+bool MultiPrint::begin()
 {
-  xSemaphoreTake(xMutex, (TickType_t)10000);
+  if (queue != nullptr)
+  {
+    return true;
+  }
+
+  queue = xRingbufferCreate(MULTI_PRINT_QUEUE_SIZE, RINGBUF_TYPE_NOSPLIT);
+  if (queue == nullptr)
+  {
+    return false;
+  }
 
+  if (xTaskCreate(dispatch, "log", MULTI_PRINT_TASK_STACK_SIZE, this, MULTI_PRINT_TASK_PRIORITY, &task) != pdPASS)
+  {
+    vRingbufferDelete(queue);
+    queue = nullptr;
+    return false;
+  }
+
+  return true;
+}
+
+// Copies the outputs to write a record of this level, and whether they must be
+// flushed after it. With late set, the ones which drop records when the queue
+// is backing up are skipped and counted.
+int MultiPrint::snapshot(Print **printers, bool *urgent, uint8_t level, bool late)
+{
+  int count = 0;
+
+  portENTER_CRITICAL_SAFE(&outputLock);
   for (int i = 0; i < outputCount; i++)
   {
-    if (output[i] == nullptr)
+    if (output[i] == nullptr || (outputLevel[i] != nullptr && level > *outputLevel[i]))
     {
       continue;
     }
-    output[i]->write(buffer, size);
+    if (late && policy[i] == LOG_SINK_DROP)
+    {
+      outputDropped[i]++;
+      continue;
+    }
+    if (urgent != nullptr)
+    {
+      urgent[count] = level <= flushLevel[i];
+    }
+    printers[count++] = output[i];
+  }
+  portEXIT_CRITICAL_SAFE(&outputLock);
+
+  return count;
+}
+
+size_t MultiPrint::writeOutputs(const uint8_t *buffer, size_t size, uint8_t level, bool late)
+{
+  // An interrupt cannot wait for the mutex
+  bool locked = !xPortInIsrContext() && xSemaphoreTake(xMutex, (TickType_t)10000) == pdTRUE;
+
+  Print *printers[MULTI_PRINT_MAX_OUTPUTS];
+  bool urgent[MULTI_PRINT_MAX_OUTPUTS];
+  int count = snapshot(printers, urgent, level, late);
+  for (int i = 0; i < count; i++)
+  {
+    printers[i]->write(buffer, size);
+    if (urgent[i])
+    {
+      printers[i]->flush();
+    }
+  }
+
+  if (locked)
+  {
+    xSemaphoreGive(xMutex); // release mutex
+  }
+
+  return size;
+}
+
+void MultiPrint::enqueue(const uint8_t *record, size_t length)
+{
+  BaseType_t sent;
+
+  if (xPortInIsrContext())
+  {
+    BaseType_t woken = pdFALSE;
+    sent = xRingbufferSendFromISR(queue, record, length, &woken);
+  }
+  else
+  {
+    sent = xRingbufferSend(queue, record, length, 0);
+  }
+
+  if (sent != pdTRUE)
+  {
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+  }
+}
+
+// Level of the line being written, the next lines go to every output again
+void MultiPrint::setRecordLevel(uint8_t level)
+{
+  portENTER_CRITICAL_SAFE(&stagingLock);
+  stagingLevel = level == LOG_LEVEL_SILENT ? MULTI_PRINT_DEFAULT_LEVEL : level;
+  portEXIT_CRITICAL_SAFE(&stagingLock);
+}
+
+// Cuts the text in records at the end of the lines. A record is the level
+// followed by the text. The records are never waited for: when the queue is
+// full, they are dropped and counted.
+size_t MultiPrint::write(const uint8_t *buffer, size_t size)
+{
+  if (queue == nullptr)
+  {
+    portENTER_CRITICAL_SAFE(&stagingLock);
+    uint8_t level = stagingLevel;
+    if (memchr(buffer, '\n', size) != nullptr)
+    {
+      stagingLevel = MULTI_PRINT_DEFAULT_LEVEL;
+    }
+    portEXIT_CRITICAL_SAFE(&stagingLock);
+
+    return writeOutputs(buffer, size, level, false);
+  }
+
+  uint8_t record[1 + MULTI_PRINT_RECORD_SIZE];
+  size_t done = 0;
+
+  while (done < size)
+  {
+    size_t length = 0;
+    bool end = false;
+
+    portENTER_CRITICAL_SAFE(&stagingLock);
+    while (done < size && !end)
+    {
+      end = buffer[done] == '\n';
+      staging[stagingLength++] = buffer[done++];
+      if (end)
+      {
+        record[0] = stagingLevel;
+        stagingLevel = MULTI_PRINT_DEFAULT_LEVEL;
+      }
+      else if (stagingLength == sizeof(staging))
+      {
+        record[0] = stagingLevel;
+        end = true;
+      }
+    }
+    if (end)
+    {
+      memcpy(&record[1], staging, stagingLength);
+      length = 1 + stagingLength;
+      stagingLength = 0;
+    }
+    portEXIT_CRITICAL_SAFE(&stagingLock);
+
+    if (length > 0)
+    {
+      enqueue(record, length);
+    }
   }
-  xSemaphoreGive(xMutex); // release mutex
 
   return size;
 }
@@ -44,51 +196,199 @@ size_t MultiPrint::write(uint8_t c)
   return MultiPrint::write(&c, 1);
 }
 
-bool MultiPrint::addOutput(Print *printer)
+// A record of level 0 (silent) is a flush marker followed by its sequence number
+void MultiPrint::dispatch(void *parameter)
 {
-  if (outputCount >= sizeof(output))
+  MultiPrint *printer = (MultiPrint *)parameter;
+
+  while (true)
+  {
+    size_t length;
+    uint8_t *record = (uint8_t *)xRingbufferReceive(printer->queue, &length, portMAX_DELAY);
+    if (record == nullptr)
+    {
+      continue;
+    }
+
+    if (length == 1 + sizeof(uint32_t) && record[0] == 0)
+    {
+      uint32_t sequence;
+      memcpy(&sequence, &record[1], sizeof(sequence));
+      __atomic_store_n(&printer->markerReached, sequence, __ATOMIC_RELEASE);
+    }
+    else
+    {
+      bool late = xRingbufferGetCurFreeSize(printer->queue) < MULTI_PRINT_QUEUE_SIZE / 2;
+      printer->writeOutputs(&record[1], length - 1, record[0], late);
+    }
+
+    vRingbufferReturnItem(printer->queue, record);
+  }
+}
+
+// Waits until the dispatcher has written everything queued before the call
+bool MultiPrint::drain()
+{
+  if (queue == nullptr || xPortInIsrContext() || xTaskGetCurrentTaskHandle() == task)
   {
     return false;
   }
 
-  xSemaphoreTake(xMutex, (TickType_t)10000);
-  output[outputCount++] = printer;
-  xSemaphoreGive(xMutex); // release mutex
+  // The end of the line is not waited for
+  uint8_t record[1 + MULTI_PRINT_RECORD_SIZE];
+  portENTER_CRITICAL(&stagingLock);
+  size_t length = stagingLength;
+  record[0] = stagingLevel;
+  memcpy(&record[1], staging, length);
+  stagingLength = 0;
+  portEXIT_CRITICAL(&stagingLock);
+  if (length > 0)
+  {
+    enqueue(record, 1 + length);
+  }
 
-  return false;
+  uint8_t marker[1 + sizeof(uint32_t)] = {0};
+  uint32_t sequence = __atomic_add_fetch(&markerSent, 1, __ATOMIC_RELAXED);
+  memcpy(&marker[1], &sequence, sizeof(sequence));
+  if (xRingbufferSend(queue, marker, sizeof(marker), pdMS_TO_TICKS(MULTI_PRINT_FLUSH_TIMEOUT)) != pdTRUE)
+  {
+    return false;
+  }
+
+  unsigned long start = millis();
+  while ((int32_t)(__atomic_load_n(&markerReached, __ATOMIC_ACQUIRE) - sequence) < 0)
+  {
+    if (millis() - start >= MULTI_PRINT_FLUSH_TIMEOUT)
+    {
+      return false;
+    }
+    vTaskDelay(1);
+  }
+
+  return true;
+}
+
+bool MultiPrint::addOutput(Print *printer, LogSinkPolicy sinkPolicy, const uint8_t *level)
+{
+  bool added = false;
+
+  portENTER_CRITICAL_SAFE(&outputLock);
+  if (outputCount < MULTI_PRINT_MAX_OUTPUTS)
+  {
+    output[outputCount] = printer;
+    policy[outputCount] = sinkPolicy;
+    outputLevel[outputCount] = level;
+    flushLevel[outputCount] = LOG_LEVEL_SILENT;
+    outputDropped[outputCount] = 0;
+    outputCount++;
+    added = true;
+  }
+  portEXIT_CRITICAL_SAFE(&outputLock);
+
+  return added;
 }
 
 bool MultiPrint::removeOutput(Print *printer)
 {
   bool found = false;
 
-  xSemaphoreTake(xMutex, (TickType_t)10000);
+  // What was written before still goes to the output
+  drain();
+  bool locked = !xPortInIsrContext() && xSemaphoreTake(xMutex, (TickType_t)10000) == pdTRUE;
 
+  portENTER_CRITICAL_SAFE(&outputLock);
   for (int i = 0; i < outputCount; i++)
   {
     if (output[i] == printer)
     {
       found = true;
-      for (int j = i; j < outputCount; j++)
+      for (int j = i; j < outputCount - 1; j++)
       {
         output[j] = output[j + 1];
-      }
-      for (int j = outputCount; j < sizeof(output); j++)
-      {
-        output[j] = nullptr;
+        policy[j] = policy[j + 1];
+        outputLevel[j] = outputLevel[j + 1];
+        flushLevel[j] = flushLevel[j + 1];
+        outputDropped[j] = outputDropped[j + 1];
       }
       outputCount--;
+      output[outputCount] = nullptr;
+      break;
     }
   }
-  xSemaphoreGive(xMutex); // release mutex
+  portEXIT_CRITICAL_SAFE(&outputLock);
+
+  if (locked)
+  {
+    xSemaphoreGive(xMutex); // release mutex
+  }
   return found;
 }
 
+// The records up to this level are flushed by the dispatcher right after being
+// written, e.g. so that the errors reach the flash. The output must support
+// being flushed from the dispatcher task.
+void MultiPrint::setFlushLevel(Print *printer, uint8_t level)
+{
+  portENTER_CRITICAL_SAFE(&outputLock);
+  for (int i = 0; i < outputCount; i++)
+  {
+    if (output[i] == printer)
+    {
+      flushLevel[i] = level;
+    }
+  }
+  portEXIT_CRITICAL_SAFE(&outputLock);
+}
+
 uint8_t MultiPrint::getOutputCount()
 {
   return outputCount;
 }
 
+// Records lost before reaching any output
+uint32_t MultiPrint::getDropped()
+{
+  return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+// Records skipped by one output
+uint32_t MultiPrint::getDropped(Print *printer)
+{
+  uint32_t count = 0;
+
+  portENTER_CRITICAL_SAFE(&outputLock);
+  for (int i = 0; i < outputCount; i++)
+  {
+    if (output[i] == printer)
+    {
+      count = outputDropped[i];
+    }
+  }
+  portEXIT_CRITICAL_SAFE(&outputLock);
+
+  return count;
+}
+
+// Level of an ESP-IDF line: "E (123) tag: ..." or "[   123][E][file.cpp:12] ..."
+static uint8_t idfLevel(const char *line)
+{
+  if (line[0] == '[')
+  {
+    const char *letter = strstr(line, "][");
+    line = letter != nullptr ? letter + 2 : line;
+  }
+
+  switch (line[0])
+  {
+  case 'E': return LOG_LEVEL_ERROR;
+  case 'W': return LOG_LEVEL_WARNING;
+  case 'I': return LOG_LEVEL_NOTICE;
+  case 'D': return LOG_LEVEL_TRACE;
+  case 'V': return LOG_LEVEL_VERBOSE;
+  }
+  return MULTI_PRINT_DEFAULT_LEVEL;
+}
+
 int MultiPrint::vprintf(const char *format, va_list args)
 {
   if (!instance)
@@ -100,16 +400,29 @@ int MultiPrint::vprintf(const char *format, va_list args)
   int len = vsnprintf(buffer, sizeof(buffer), format, args);
   if (len > 0)
   {
+    instance->setRecordLevel(idfLevel(buffer));
     printTimestamp(instance);
-    return instance->write((uint8_t *)buffer, len);
+    return instance->write((uint8_t *)buffer, min(len, (int)sizeof(buffer) - 1));
   }
   return 0;
 }
 
+// Barrier: returns once everything written before is in the outputs, then
+// flushes them in the context of the caller
 void MultiPrint::flush()
 {
-  for (int i = 0; i < outputCount; i++)
+  drain();
+  bool locked = !xPortInIsrContext() && xSemaphoreTake(xMutex, (TickType_t)10000) == pdTRUE;
+
+  Print *printers[MULTI_PRINT_MAX_OUTPUTS];
+  int count = snapshot(printers, nullptr, LOG_LEVEL_SILENT, false);
+  for (int i = 0; i < count; i++)
+  {
+    printers[i]->flush();
+  }
+
+  if (locked)
   {
-    output[i]->flush();
+    xSemaphoreGive(xMutex); // release mutex
   }
 }
@@ -1,34 +1,91 @@
+#ifndef MULTI_PRINT_H
+#define MULTI_PRINT_H
+
 #include <cstddef>
 #include <Print.h>
 #include <cstdarg>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/semphr.h>
+#include <freertos/ringbuf.h>
 #include <cstdio>
 #include <esp_log.h>
 #include "PrintUtils.h"
+#include "LogFloor.h"
 #include <sys/_stdint.h>
 #include <stdlib.h>
 
+#define MULTI_PRINT_MAX_OUTPUTS 4
+#define MULTI_PRINT_QUEUE_SIZE 4096      // bytes of records waiting for the dispatcher
+#define MULTI_PRINT_RECORD_SIZE 160      // bytes, longer lines are split in several records
+#define MULTI_PRINT_TASK_STACK_SIZE 4096
+#define MULTI_PRINT_TASK_PRIORITY tskIDLE_PRIORITY  // below the loop task, runs while it waits
+#define MULTI_PRINT_FLUSH_TIMEOUT 2000   // ms
+#define MULTI_PRINT_DEFAULT_LEVEL LOG_LEVEL_FATAL  // text written without a level goes to every output
+
+// What the dispatcher does when it is late
+enum LogSinkPolicy {
+    LOG_SINK_BLOCK = 0,                 // every record is written, the queue absorbs a slow sink
+    LOG_SINK_DROP                       // records are skipped while the queue is more than half full
+};
+
+// Copies the log to several outputs. Once begin() is called, the writers only
+// append whole records to a queue and a task of the idle priority writes them
+// to the outputs whenever the writers wait, so a slow file or MQTT output does
+// not hold back the measures.
+// Each record keeps the level of its line, set by setRecordLevel(), and each
+// output can have its own maximum level.
 class MultiPrint : public Print
 {
     private:
-        Print ** output;
+        Print * output[MULTI_PRINT_MAX_OUTPUTS];
+        uint8_t policy[MULTI_PRINT_MAX_OUTPUTS];
+        const uint8_t * outputLevel[MULTI_PRINT_MAX_OUTPUTS];    // read on each record, nullptr for all levels
+        uint8_t flushLevel[MULTI_PRINT_MAX_OUTPUTS];             // records up to this level are flushed at once
+        uint32_t outputDropped[MULTI_PRINT_MAX_OUTPUTS];
         int outputCount = 0;
+        portMUX_TYPE outputLock = portMUX_INITIALIZER_UNLOCKED;
+
+        // Current record, sent to the queue at the end of the line
+        uint8_t staging[MULTI_PRINT_RECORD_SIZE];
+        size_t stagingLength = 0;
+        uint8_t stagingLevel = MULTI_PRINT_DEFAULT_LEVEL;
+        portMUX_TYPE stagingLock = portMUX_INITIALIZER_UNLOCKED;
+
+        RingbufHandle_t queue = nullptr;
+        TaskHandle_t task = nullptr;
+        uint32_t dropped = 0;           // records lost because the queue was full
+        uint32_t markerSent = 0;        // flush markers, see drain()
+        uint32_t markerReached = 0;
 
         static int vprintf(const char *format, va_list args);
-        SemaphoreHandle_t xMutex;
+        static void dispatch(void *parameter);
+        SemaphoreHandle_t xMutex;       // held while a record is written to the outputs
+
+        int snapshot(Print ** printers, bool * urgent, uint8_t level, bool late);
+        size_t writeOutputs(const uint8_t * buffer, size_t size, uint8_t level, bool late);
+        void enqueue(const uint8_t * record, size_t length);
+        bool drain();
     public:
         MultiPrint();
         ~MultiPrint();
         static MultiPrint *instance;
 
+        bool begin();
+
         size_t write(const uint8_t * buffer, size_t size) override;
         size_t write(uint8_t c) override;
+        void setRecordLevel(uint8_t level);
 
-        bool addOutput(Print * printer);
+        bool addOutput(Print * printer, LogSinkPolicy sinkPolicy = LOG_SINK_BLOCK, const uint8_t * level = nullptr);
         bool removeOutput(Print * printer);
+        void setFlushLevel(Print * printer, uint8_t level);
         uint8_t getOutputCount();
 
+        uint32_t getDropped();
+        uint32_t getDropped(Print * printer);
+
         void flush();
 };
+
+#endif
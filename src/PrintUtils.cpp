@@ -1,4 +1,5 @@
 #include "PrintUtils.h"
+#include "MultiPrint.h"
 
 void printTimestamp(Print* _logOutput) {
 
@@ -20,6 +21,10 @@ void printTimestamp(Print* _logOutput) {
 }
 
 void printPrefix(Print* _logOutput, int logLevel) {
+    // The outputs of a MultiPrint filter the line on its level
+    if (_logOutput == MultiPrint::instance) {
+        MultiPrint::instance->setRecordLevel(logLevel);
+    }
     printTimestamp(_logOutput);
     //printLogLevel (_logOutput, logLevel);
 }
\ No newline at end of file
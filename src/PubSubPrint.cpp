@@ -2,102 +2,121 @@
 #include "PubSubPrint.h"
 #include "Arduino.h"
 
-#define max(a,b) \
-   ({ __typeof__ (a) _a = (a); \
-       __typeof__ (b) _b = (b); \
-     _a > _b ? _a : _b; })
+#define MASK (PUBSUB_PRINT_BUFFER_SIZE - 1)
 
 PubSubPrint::PubSubPrint(PubSubClient* pbClient, const char* pbTopic) {
   client = pbClient;
-  _buffer = (unsigned char *) malloc(1024);
-  _buffer[0] = 0;
-
-  size_t len = strlen(pbTopic);
-  topic = (char *) malloc((len + 1) * sizeof(char));
-  memcpy(topic, pbTopic, len * sizeof(char));
-  topic[len] = 0;
+  topic = pbTopic;
 }
 
-size_t PubSubPrint::write(const uint8_t * buffer, size_t size) {
-    bool sent = false;
+// Producer side: only moves head and lineEnd
+size_t PubSubPrint::append(const uint8_t * buffer, size_t size) {
+    uint16_t start = head;
+    uint16_t used = start - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    size_t count = min(size, (size_t)(PUBSUB_PRINT_BUFFER_SIZE - used));
 
-    if (pos + size < 1024) {
-      memcpy(&_buffer[pos], buffer, size);
-      pos += size;
+    if (count < size) {
+      dropped += size - count;
     }
 
-    bool fullString = false;
-    for (int i = 0; !fullString && i < pos; i++) {
-      fullString = _buffer[i] == '\n' || _buffer[i] == 0;
+    size_t first = min(count, (size_t)(PUBSUB_PRINT_BUFFER_SIZE - (start & MASK)));
+    memcpy(&_buffer[start & MASK], buffer, first);
+    memcpy(_buffer, &buffer[first], count - first);
+
+    // Only the new bytes are searched for the end of a line
+    uint16_t end = lineEnd;
+    for (size_t i = count; i > 0; i--) {
+      if (buffer[i - 1] == '\n') {
+        end = start + i;
+        break;
+      }
     }
-    //Serial.printf("Fullsting = %u, pos = %u, suspended = %u, connected = %u\n", fullString, pos, suspended, client->connected());
 
-    if (!suspended && (fullString || pos > 800)) {
-      if (!client->connected()) {
-        String clientId = "waterLevel-";
-        clientId += String(random(0xffff), HEX);
-        client->connect(clientId.c_str());
+    __atomic_store_n(&head, (uint16_t)(start + count), __ATOMIC_RELEASE);
+    __atomic_store_n(&lineEnd, end, __ATOMIC_RELEASE);
+    return count;
+}
+
+// Consumer side: only moves tail
+bool PubSubPrint::publish() {
+    while (true) {
+      uint16_t start = tail;
+      uint16_t used = __atomic_load_n(&head, __ATOMIC_ACQUIRE) - start;
+      uint16_t complete = __atomic_load_n(&lineEnd, __ATOMIC_ACQUIRE) - start;
+
+      // The last newline may already have been sent with a long line
+      if (complete > used) {
+        complete = 0;
       }
-      int start = 0;
-      int end = 0;
-      while (end < pos) {
-        while (end < pos && _buffer[end] != 0 && _buffer[end] != '\n') {
-          end++;
+
+      uint16_t length = complete;
+      if (length == 0) {
+        // A line longer than a packet is sent in pieces
+        if (used < PUBSUB_PRINT_PACKET_SIZE) {
+          return true;
+        }
+        length = PUBSUB_PRINT_PACKET_SIZE;
+      } else if (length > PUBSUB_PRINT_PACKET_SIZE) {
+        // As many complete lines as fit in the packet
+        length = PUBSUB_PRINT_PACKET_SIZE;
+        while (length > 0 && _buffer[(start + length - 1) & MASK] != '\n') {
+          length--;
         }
-        //Serial.printf("Start = %u, end = %u\n", start, end);
-        if (end > start && end < pos) {
-          char message[end - start];
-          memcpy(message, &_buffer[start], end - start);
-          message[end - start] = 0;
-          //Serial.printf("Sending to MQTT: %d bytes [%d - %d] (%s)\n", end - start, start, end, message);
-          sent = client->publish(topic, (const char *) &message);
-          //Serial.printf("Sent: %d on topic %s\n", sent, topic);
-          client->flush();
-          delay(20);
-          start = end + 1;
-          end = start;
+        if (length == 0) {
+          length = PUBSUB_PRINT_PACKET_SIZE;
         }
       }
 
-      client->flush();
-      //Serial.printf("Start: %d, end: %d, pos: %d\n", start, end, pos);
-
-      if (start >= pos) {
-        end = pos;
-        pos = 0;
-        return pos;
+      // The newline closing the message is not sent
+      uint16_t payload = length;
+      if (_buffer[(start + payload - 1) & MASK] == '\n') {
+        payload--;
       }
 
-      if (start < pos) {
-        // Keep the messages not sent for later
-        char swap[pos - start];
-        memcpy(swap, &_buffer[start], pos - start);
-        memcpy(_buffer, swap, pos - start);
-        pos = pos - start;
-        return start;
+      size_t first = min((size_t)payload, (size_t)(PUBSUB_PRINT_BUFFER_SIZE - (start & MASK)));
+      if (payload > 0 && (!client->beginPublish(topic, payload, false) ||
+          client->write(&_buffer[start & MASK], first) != first ||
+          client->write(_buffer, payload - first) != payload - first ||
+          !client->endPublish())) {
+        return false;
       }
+
+      __atomic_store_n(&tail, (uint16_t)(start + length), __ATOMIC_RELEASE);
     }
+}
 
-    return 0;
+size_t PubSubPrint::write(const uint8_t * buffer, size_t size) {
+    // The client is not thread safe, the lines are sent by flush()
+    append(buffer, size);
+    return size;
 }
 
 size_t PubSubPrint::write(uint8_t c) {
     return write(&c, 1);
 }
 
-size_t PubSubPrint::saveBufferData(uint8_t * buffer) {
-  _buffer[pos] = 0;
-  memcpy(buffer, _buffer, pos);
+// Copy the lines not sent yet, oldest first
+size_t PubSubPrint::saveBufferData(uint8_t * buffer, size_t size) {
+  uint16_t start = tail;
+  size_t length = min((size_t)(uint16_t)(head - start), size);
+  size_t first = min(length, (size_t)(PUBSUB_PRINT_BUFFER_SIZE - (start & MASK)));
 
-  return pos;
+  memcpy(buffer, &_buffer[start & MASK], first);
+  memcpy(&buffer[first], _buffer, length - first);
+
+  return length;
 }
 
 size_t PubSubPrint::loadBufferData(uint8_t * buffer, size_t length) {
-  memcpy(_buffer, buffer, length);
-  _buffer[length] = 0;
-  pos = length;
+  head = 0;
+  tail = 0;
+  lineEnd = 0;
+
+  return append(buffer, length);
+}
 
-  return pos;
+uint32_t PubSubPrint::getDropped() {
+  return dropped;
 }
 
 void PubSubPrint::setSuspend(bool suspend) {
@@ -108,5 +127,7 @@ void PubSubPrint::setSuspend(bool suspend) {
 }
 
 void PubSubPrint::flush() {
-  PubSubPrint::write(0, 0);
+  if (!suspended && client->connected()) {
+    publish();
+  }
 }
@@ -5,15 +5,32 @@
 #include <Print.h>
 #include <PubSubClient.h>
 
+#define PUBSUB_PRINT_BUFFER_SIZE 1024   // bytes, power of 2
+#define PUBSUB_PRINT_PACKET_SIZE 512    // bytes of log lines per MQTT message
+
+static_assert((PUBSUB_PRINT_BUFFER_SIZE & (PUBSUB_PRINT_BUFFER_SIZE - 1)) == 0, "The buffer size must be a power of 2");
+
+// Sends the log lines over MQTT, as many complete lines per message as fit in a
+// packet. The lines are kept in a single producer, single consumer ring buffer:
+// write() only appends, it runs in the log dispatcher task which must not use
+// the client. flush() sends the lines once the client is connected and the
+// output is not suspended.
 class PubSubPrint : public Print
 {
     private:
         PubSubClient * client;
-        char * topic;
+        const char * topic;             // must outlive the printer
         bool suspended = false;
 
-        uint8_t * _buffer;
-        uint16_t pos = 0;
+        uint8_t _buffer[PUBSUB_PRINT_BUFFER_SIZE];
+        // Free running indexes, masked when accessing the buffer
+        uint16_t head = 0;              // next byte written
+        uint16_t tail = 0;              // next byte sent
+        uint16_t lineEnd = 0;           // after the last newline written
+        uint32_t dropped = 0;           // bytes lost because the buffer was full
+
+        size_t append(const uint8_t * buffer, size_t size);
+        bool publish();
 
     public:
         PubSubPrint(PubSubClient * pbClient, const char * pbTopic);
@@ -23,9 +40,11 @@ class PubSubPrint : public Print
 
         void setSuspend(bool suspend);
 
-        size_t saveBufferData(uint8_t * buffer);
+        size_t saveBufferData(uint8_t * buffer, size_t size = PUBSUB_PRINT_BUFFER_SIZE);
         size_t loadBufferData(uint8_t * buffer, size_t length);
 
+        uint32_t getDropped();
+
         void flush();
 };
 
@@ -1,6 +1,6 @@
 #include "Arduino.h"
 #include <WiFi.h>
 #include "global_vars.h"
-#include <ArduinoLog.h>
+#include "LogFloor.h"
 
 bool initWiFi();
\ No newline at end of file
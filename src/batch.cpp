@@ -0,0 +1,180 @@
+#include "batch.h"
+#include "topics.h"
+#include <time.h>
+
+/*********************\
+ * Reading batching *
+\*********************/
+
+// Readings are kept in a ring buffer in RTC memory so they survive deep sleep.
+// The radio is only started when the batch is due and all the readings are then
+// sent in a single message.
+RTC_DATA_ATTR Reading  readingBuffer[MAX_BATCH_DEPTH];
+RTC_DATA_ATTR uint16_t readingHead = 0;     // index of the oldest reading
+RTC_DATA_ATTR uint16_t readingCount = 0;
+RTC_DATA_ATTR uint16_t readingDropped = 0;
+RTC_DATA_ATTR uint16_t wakesSinceReport = 0;
+
+// Last values sent, for report by exception
+RTC_DATA_ATTR uint16_t lastSentLevel[PROBE_COUNT];
+RTC_DATA_ATTR float    lastSentVoltage = 0;
+
+// Largest line: "4294967295,255,65535,255\n"
+static char batchMsg[MAX_BATCH_DEPTH * 26 + 32];
+
+void batchAdd(uint8_t probe, int distance)
+{
+    if (readingCount >= batchDepth)
+    {
+        // Buffer full: the oldest reading is lost
+        Log.warningln(F("Reading buffer full. Dropping oldest reading"));
+        readingHead = (readingHead + 1) % MAX_BATCH_DEPTH;
+        readingCount--;
+        readingDropped++;
+    }
+
+    Reading &r = readingBuffer[(readingHead + readingCount) % MAX_BATCH_DEPTH];
+    r.timestamp = (uint32_t)time(nullptr);
+    r.probe = probe;
+    r.status = distance > 0 ? READING_OK : READING_FAILED;
+    r.distance = distance > 0 ? (uint16_t)distance : 0;
+    readingCount++;
+}
+
+uint16_t batchCount()
+{
+    return readingCount;
+}
+
+bool batchDue(bool alert)
+{
+    wakesSinceReport++;
+
+    if (!rtcValid)
+    {
+        return true;
+    }
+
+    if (alert)
+    {
+        Log.noticeln(F("Alert raised. Reporting now"));
+        return true;
+    }
+
+    // Called before the readings of this wake are added: report now if the
+    // readings of the next wake would not fit in the buffer. Without batching
+    // too, as report by exception keeps the readings of the quiet wakes.
+    if (readingCount + 2 * PROBE_COUNT > batchDepth)
+    {
+        Log.verboseln(F("Reading buffer nearly full (%d readings)"), readingCount);
+        return true;
+    }
+
+    if (reportDelta > 0)
+    {
+        // Report by exception: only the heartbeat is known before measuring
+        if (wakesSinceReport >= heartbeatInterval)
+        {
+            Log.verboseln(F("Heartbeat due after %d wakes"), wakesSinceReport);
+            return true;
+        }
+        return false;
+    }
+
+    if (batchSize <= 1 || wakesSinceReport >= batchSize)
+    {
+        Log.verboseln(F("Batch due after %d wakes"), wakesSinceReport);
+        return true;
+    }
+
+    return false;
+}
+
+// True when the battery voltage is on different sides of a threshold
+static bool crossed(float voltage, float threshold)
+{
+    return (lastSentVoltage <= threshold) != (voltage <= threshold);
+}
+
+bool levelsChanged(const long *levels, float voltage)
+{
+    if (reportDelta == 0)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
+    {
+        if (levels[i] < CLOSEST || levels[i] > FARTHEST)
+        {
+            continue;
+        }
+
+        if (lastSentLevel[i] == 0 || abs(levels[i] - lastSentLevel[i]) > reportDelta)
+        {
+            Log.noticeln(F("Level %d moved from %d to %d mm. Reporting now"), i, lastSentLevel[i], levels[i]);
+            return true;
+        }
+    }
+
+    if (crossed(voltage, BATTERY_ALERT_THRESHOLD) || crossed(voltage, BATTERY_ALERT_REARM) || crossed(voltage, onPowerThreshold))
+    {
+        Log.noticeln(F("Voltage crossed a threshold (%F V). Reporting now"), voltage);
+        return true;
+    }
+
+    return false;
+}
+
+bool batchPublish()
+{
+    if (readingCount == 0 || (batchSize <= 1 && readingCount <= PROBE_COUNT))
+    {
+        // Not batching: the readings of this wake are sent on their own topics.
+        // Readings kept while the device could not report are still sent below.
+        readingHead = 0;
+        readingCount = 0;
+        readingDropped = 0;
+        return true;
+    }
+
+    // Header: current time, so the receiver can date the readings, count and dropped readings
+    size_t len = snprintf(batchMsg, sizeof(batchMsg), "%lu,%u,%u\n",
+                          (unsigned long)time(nullptr), readingCount, readingDropped);
+
+    for (uint16_t i = 0; i < readingCount; i++)
+    {
+        const Reading &r = readingBuffer[(readingHead + i) % MAX_BATCH_DEPTH];
+        len += snprintf(&batchMsg[len], sizeof(batchMsg) - len, "%lu,%u,%u,%u\n",
+                        (unsigned long)r.timestamp, r.probe, r.distance, r.status);
+    }
+
+    // Stream the message so it is not limited by the MQTT client buffer size
+    if (!client.beginPublish(getTopic(TOPIC_BATCH), len, false) ||
+        client.write((const uint8_t *)batchMsg, len) != len ||
+        !client.endPublish())
+    {
+        Log.errorln(F("Failed to send %d buffered readings. Keeping them for next report"), readingCount);
+        return false;
+    }
+
+    Log.noticeln(F("%d buffered readings sent"), readingCount);
+    readingHead = (readingHead + readingCount) % MAX_BATCH_DEPTH;
+    readingCount = 0;
+    readingDropped = 0;
+    return true;
+}
+
+void batchReported(const long *levels, float voltage)
+{
+    wakesSinceReport = 0;
+
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
+    {
+        if (levels[i] >= CLOSEST && levels[i] <= FARTHEST)
+        {
+            lastSentLevel[i] = levels[i];
+        }
+    }
+    lastSentVoltage = voltage;
+}
@@ -0,0 +1,27 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "Arduino.h"
+#include "global_vars.h"
+#include "LogFloor.h"
+
+// Status of a buffered reading
+#define READING_OK      0
+#define READING_FAILED  1
+
+// One measurement kept in RTC memory until it is reported (8 bytes)
+struct Reading {
+    uint32_t timestamp;                  // s, RTC time (survives deep sleep)
+    uint16_t distance;                   // mm
+    uint8_t  probe;
+    uint8_t  status;
+};
+
+void     batchAdd(uint8_t probe, int distance);
+bool     batchDue(bool alert);
+bool     levelsChanged(const long *levels, float voltage);
+uint16_t batchCount();
+bool     batchPublish();
+void     batchReported(const long *levels, float voltage);
+
+#endif
@@ -0,0 +1,70 @@
+#include "configure.h"
+#include "settings.h"
+#include "ArenaAllocator.h"
+
+/*****************\
+ * Configuration *
+\*****************/
+
+// Fixed capacity document, parsed straight from the MQTT buffer
+static ArenaAllocator<CONFIG_ARENA_SIZE> configAllocator;
+
+// Apply the settings of a config object. Returns the number of settings changed.
+int applyConfig(JsonObjectConst conf)
+{
+    Log.traceln(F("Number of keypairs: %d"), conf.size());
+    int changed = 0;
+
+    // Loop through all the key-value pairs in obj
+    for (JsonPairConst p : conf)
+    {
+        const char *key = p.key().c_str();
+        uint8_t index;
+
+        const SettingInfo *info = findSetting(key, index);
+        if (info == NULL)
+        {
+            Log.warningln(F("Unknown config parameter: %s"), key);
+            continue;
+        }
+
+        if (!p.value().is<double>())
+        {
+            Log.warningln(F("Config parameter %s must be a number"), key);
+            continue;
+        }
+
+        Log.traceln(F("Processing: { \"%s\": %D }"), key, p.value().as<double>());
+        if (applySetting(info, index, p.value().as<double>()))
+        {
+            changed++;
+        }
+    }
+
+    for (int i = 0; i < PROBE_COUNT; i++) {
+        if (minLevel[i] < maxLevel[i])
+        {
+            Log.warningln("Minimum level %d should be bigger than maximum level because the water is further away from the sensor when the level is at its minimum.", i);
+        }
+    }
+
+    return changed;
+}
+
+// Parse a config message and apply it. Returns the number of settings changed,
+// or -1 if the message is not valid JSON or does not fit in the arena.
+int configParse(const char *payload, unsigned int length)
+{
+    configAllocator.reset();
+    JsonDocument doc(&configAllocator);
+
+    DeserializationError error = deserializeJson(doc, payload, length);
+    if (error)
+    {
+        Log.errorln(F("deserializeJson() failed: %s"), error.c_str());
+        return -1;
+    }
+
+    Log.traceln(F("Config parsed (%d bytes used)"), configAllocator.peak());
+    return applyConfig(doc.as<JsonObjectConst>());
+}
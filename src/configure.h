@@ -0,0 +1,12 @@
+#ifndef CONFIGURE_H
+#define CONFIGURE_H
+
+#include "Arduino.h"
+#include "global_vars.h"
+#include <ArduinoJson.h>
+#include "LogFloor.h"
+
+int applyConfig(JsonObjectConst conf);
+int configParse(const char *payload, unsigned int length);
+
+#endif
@@ -0,0 +1,147 @@
+#include "connection.h"
+#include "topics.h"
+
+/**************\
+ * Connection *
+\**************/
+
+// When the broker or the access point is down, every wake would spend seconds of
+// radio time failing to connect. After CONNECT_BACKOFF_THRESHOLD failed wakes,
+// the next connections are skipped for a doubling number of wakes while the
+// readings stay buffered.
+RTC_DATA_ATTR uint8_t  connectFailures = 0;     // consecutive wakes without MQTT
+RTC_DATA_ATTR uint16_t backoffWakes = 0;        // wakes left without connecting
+RTC_DATA_ATTR uint32_t connectLatency = 0;      // ms, last successful connection
+
+// Called once per wake. Urgent reports (alerts) ignore the backoff.
+bool connectionAllowed(bool urgent)
+{
+    if (backoffWakes == 0)
+    {
+        return true;
+    }
+
+    backoffWakes--;
+    if (urgent)
+    {
+        Log.noticeln(F("Connecting despite the backoff"));
+        return true;
+    }
+
+    Log.noticeln(F("Connection skipped after %d failures (%d more wakes)"), connectFailures, backoffWakes);
+    return false;
+}
+
+void connectionDone(bool connected, uint32_t latency)
+{
+    if (connected)
+    {
+        if (connectFailures > 0)
+        {
+            Log.noticeln(F("Connected after %d failed wakes"), connectFailures);
+        }
+        connectFailures = 0;
+        backoffWakes = 0;
+        connectLatency = latency;
+        return;
+    }
+
+    if (connectFailures < UINT8_MAX)
+    {
+        connectFailures++;
+    }
+
+    if (connectFailures >= CONNECT_BACKOFF_THRESHOLD)
+    {
+        uint8_t shift = min(connectFailures - CONNECT_BACKOFF_THRESHOLD, 15);
+        backoffWakes = min(1U << shift, (unsigned int)CONNECT_BACKOFF_MAX_WAKES);
+        Log.warningln(F("%d failed connections, skipping the next %d wakes"), connectFailures, backoffWakes);
+    }
+}
+
+uint8_t connectionFailures()
+{
+    return connectFailures;
+}
+
+uint16_t connectionBackoff()
+{
+    return backoffWakes;
+}
+
+uint32_t connectionLatency()
+{
+    return connectLatency;
+}
+
+// The only place where the MQTT connection is made
+bool reconnect()
+{
+    // Init MQTT
+    client.setServer(MQTT_SERVER, 1883);
+    unsigned long start = millis();
+    uint16_t retryDelay = CONNECT_RETRY_DELAY;
+    int i = CONNECT_ATTEMPTS;
+
+    // Loop until we're reconnected
+    while (!client.connected() && i > 0)
+    {
+        Log.noticeln(F("Connecting to MQTT"));
+
+        char clientId[24];
+        if (persistentSession)
+        {
+            // The broker finds the session back from a stable client ID
+            uint8_t mac[6];
+            WiFi.macAddress(mac);
+            snprintf(clientId, sizeof(clientId), "waterLevel-%02x%02x%02x%02x%02x%02x",
+                     mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        }
+        else
+        {
+            // Create a random client ID
+            snprintf(clientId, sizeof(clientId), "waterLevel-%lx", random(0xffff));
+        }
+
+        // Queued commands are delivered as soon as the session is resumed
+        client.setCallback(callback);
+
+        // Attempt to connect
+        if (client.connect(clientId, NULL, NULL, NULL, 0, false, NULL, !persistentSession))
+        {
+            // The subscriptions of a persistent session are kept by the broker. They are
+            // refreshed from time to time in case it lost the session.
+            if (!persistentSession || !sessionSubscribed || run % SESSION_REFRESH_INTERVAL == 0)
+            {
+                for (uint8_t id = 0; id < TOPIC_SUBSCRIBED_COUNT; id++)
+                {
+                    client.subscribe(getTopic(id), persistentSession ? 1 : 0);
+                }
+                sessionSubscribed = persistentSession;
+                Log.noticeln(F("Subscription done"));
+                delay(100);
+            }
+
+            connectionDone(true, millis() - start);
+            Log.noticeln(F("MQTT connected in %l ms"), millis() - start);
+            return true;
+        }
+
+        i--;
+        if (i > 0)
+        {
+            Log.errorln(F("Failed, rc=%d try again in %d ms"), client.state(), retryDelay);
+            delay(retryDelay);
+            retryDelay *= 2;
+        }
+    }
+
+    if (!client.connected())
+    {
+        Log.warningln(F("Failed to connect to MQTT, rc=%d"), client.state());
+        connectionDone(false, 0);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,18 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "Arduino.h"
+#include "global_vars.h"
+#include "LogFloor.h"
+
+// Handler of the received messages, in mqtt.cpp
+void callback(char *topic, byte *payload, unsigned int length);
+
+bool     reconnect();
+bool     connectionAllowed(bool urgent);
+void     connectionDone(bool connected, uint32_t latency);
+uint8_t  connectionFailures();
+uint16_t connectionBackoff();
+uint32_t connectionLatency();
+
+#endif
@@ -0,0 +1,176 @@
+#include "files.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+/*********\
+ * Files *
+\*********/
+
+// Walk a directory once: the size and time come from stat(), which only reads
+// the metadata, instead of opening every file. Returns the number of entries
+// visited or -1 if the directory cannot be opened. LittleFS must be mounted.
+int listDir(const char *dirName, FileVisitor visitor, void *context)
+{
+    char path[sizeof(BASE_PATH) + 2 * FILE_NAME_MAX_LENGTH];
+    size_t dirLength = snprintf(path, sizeof(path), "%s%s", BASE_PATH, dirName);
+    if (dirLength >= sizeof(path) - FILE_NAME_MAX_LENGTH)
+    {
+        Log.errorln(F("Directory name too long: %s"), dirName);
+        return -1;
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        return -1;
+    }
+
+    if (path[dirLength - 1] != '/')
+    {
+        path[dirLength++] = '/';
+    }
+
+    int count = 0;
+    struct dirent *entry;
+    FileEntry file;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strlen(entry->d_name) >= sizeof(file.name))
+        {
+            Log.warningln(F("File name too long, skipped: %s"), entry->d_name);
+            continue;
+        }
+
+        strcpy(file.name, entry->d_name);
+        strcpy(&path[dirLength], entry->d_name);
+
+        struct stat info;
+        if (stat(path, &info) != 0)
+        {
+            continue;
+        }
+
+        file.size = info.st_size;
+        file.mtime = info.st_mtime;
+        file.isDir = S_ISDIR(info.st_mode);
+        count++;
+
+        if (!visitor(file, context))
+        {
+            break;
+        }
+    }
+
+    closedir(dir);
+    return count;
+}
+
+// Listing of a directory on ROOT_TOPIC/file/dir<name>, in pages
+void dirPageBegin(DirPage &page, const char *dirName)
+{
+    snprintf(page.topic, sizeof(page.topic), "%s", topicWith(TOPIC_FILE_DIR, dirName));
+    page.length = 0;
+    page.number = 0;
+
+    // Room left by the fixed header, the topic and the page header
+    int capacity = MQTT_MAX_PACKET_SIZE - 16 - (int)strlen(page.topic);
+    page.capacity = capacity > 0 ? capacity : 0;
+}
+
+// "page,last\n" followed by the entries
+bool dirPageSend(DirPage &page, bool last)
+{
+    char header[16];
+    size_t headerLength = snprintf(header, sizeof(header), "%u,%d\n", page.number, last);
+
+    bool sent = client.beginPublish(page.topic, headerLength + page.length, false) &&
+                client.write((const uint8_t *)header, headerLength) == headerLength &&
+                client.write((const uint8_t *)page.data, page.length) == page.length &&
+                client.endPublish();
+    if (!sent)
+    {
+        Log.errorln(F("Failed to send page %d of the listing"), page.number);
+    }
+
+    page.number++;
+    page.length = 0;
+    return sent;
+}
+
+// "name,size,mtime\n", directories end with '/'
+bool dirPageAdd(const FileEntry &entry, void *context)
+{
+    DirPage &page = *(DirPage *)context;
+    char line[FILE_NAME_MAX_LENGTH + 32];
+    size_t length = snprintf(line, sizeof(line), "%s%s,%lu,%lu\n", entry.name, entry.isDir ? "/" : "",
+                             (unsigned long)entry.size, (unsigned long)entry.mtime);
+
+    if (page.length > 0 && page.length + length > page.capacity)
+    {
+        dirPageSend(page, false);
+    }
+
+    memcpy(&page.data[page.length], line, length);
+    page.length += length;
+    return true;
+}
+
+// Copy a name received without terminating 0. Returns false if it is empty or
+// does not fit in FILE_NAME_MAX_LENGTH.
+bool copyFileName(char *name, const char *source, size_t length)
+{
+    if (length == 0)
+    {
+        Log.errorln(F("File name is empty"));
+        return false;
+    }
+
+    if (length >= FILE_NAME_MAX_LENGTH)
+    {
+        Log.errorln(F("File name too long (%d characters)"), length);
+        return false;
+    }
+
+    memcpy(name, source, length);
+    name[length] = 0;
+    return true;
+}
+
+// Read a transfer request straight from the message, without copying it
+bool parseFileRequest(const char *request, size_t length, FileRequest &parsed)
+{
+    const char *comma = (const char *)memchr(request, ',', length);
+    size_t nameLength = comma == NULL ? length : comma - request;
+
+    parsed.offset = 0;
+    parsed.length = UINT32_MAX;
+    if (!copyFileName(parsed.name, request, nameLength))
+    {
+        return false;
+    }
+
+    if (comma == NULL)
+    {
+        return true;
+    }
+
+    // "offset" or "offset,length", at most 2 numbers of 10 digits
+    char range[24];
+    size_t rangeLength = length - nameLength - 1;
+    if (rangeLength >= sizeof(range))
+    {
+        Log.errorln(F("Invalid range in the request for %s"), parsed.name);
+        return false;
+    }
+    memcpy(range, comma + 1, rangeLength);
+    range[rangeLength] = 0;
+
+    char *next;
+    parsed.offset = strtoul(range, &next, 10);
+    if (*next == ',')
+    {
+        parsed.length = strtoul(next + 1, NULL, 10);
+    }
+    return true;
+}
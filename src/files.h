@@ -0,0 +1,43 @@
+#ifndef FILES_H
+#define FILES_H
+
+#include "Arduino.h"
+#include "global_vars.h"
+#include "LogFloor.h"
+#include "topics.h"
+
+// Directory entry, read from the LittleFS metadata without opening the file
+struct FileEntry {
+    char     name[FILE_NAME_MAX_LENGTH];  // without the directory
+    uint32_t size;                        // bytes
+    uint32_t mtime;                       // s, device time of the last modification
+    bool     isDir;
+};
+
+// Called for each entry. Returns false to stop the listing.
+typedef bool (*FileVisitor)(const FileEntry &entry, void *context);
+
+// File and range of a transfer request: "name", "name,offset" or "name,offset,length"
+struct FileRequest {
+    char     name[FILE_NAME_MAX_LENGTH];
+    uint32_t offset;
+    uint32_t length;                      // UINT32_MAX: up to the end of the file
+};
+
+// Page of a directory listing, sized to fit in an MQTT packet
+struct DirPage {
+    char     topic[TOPIC_MAX_LENGTH * 2];  // own copy, topicWith() reuses its buffer
+    size_t   capacity;
+    size_t   length;
+    uint16_t number;
+    char     data[MQTT_MAX_PACKET_SIZE];
+};
+
+int  listDir(const char *dirName, FileVisitor visitor, void *context);
+void dirPageBegin(DirPage &page, const char *dirName);
+bool dirPageAdd(const FileEntry &entry, void *context);
+bool dirPageSend(DirPage &page, bool last);
+bool copyFileName(char *name, const char *source, size_t length);
+bool parseFileRequest(const char *request, size_t length, FileRequest &parsed);
+
+#endif
@@ -6,6 +6,7 @@
 #include <PubSubClient.h>
 #include <Preferences.h>
 #include "PubSubPrint.h"
+#include "probes.h"
 
 // Constants
 #define BATTERY_ALERT_THRESHOLD 2.0 // V
@@ -16,35 +17,83 @@
 
 #define DEFAULT_SLEEP_TIME 5e6   // us
 
+#define DEFAULT_BURST_SIZE 5      // readings per measurement
+#define MAX_BURST_SIZE 15         // readings
+#define DEFAULT_BURST_THRESHOLD 30 // outlier rejection, in tenths of median absolute deviation
+#define BURST_MIN_SPREAD 10       // mm, readings closer than this to the median are always kept
+#define BURST_MIN_CONFIDENCE 50   // %, share of the readings to keep for a valid measure
+#define BURST_INTERVAL_MS 30      // ms, let the echoes die down between 2 readings
+
+#define DEFAULT_BATCH_SIZE 1     // wakes between reports (1 = report every wake)
+#define DEFAULT_BATCH_DEPTH 32   // readings
+#define MAX_BATCH_DEPTH 64       // readings kept in RTC memory
+
+#define DEFAULT_REPORT_DELTA 0   // mm, level change that triggers a report (0 = report on every batch)
+#define DEFAULT_HEARTBEAT_INTERVAL 60 // wakes between 2 reports when nothing changes
+
+#define DEFAULT_PROFILE_INTERVAL 100 // cycles between 2 profile reports (0 = never)
+
+#define DEFAULT_DRAIN_TIMEOUT 1000  // ms, longest wait for the pending messages after reporting
+#define CONNECT_ATTEMPTS 3             // MQTT connections tried per wake
+#define CONNECT_RETRY_DELAY 250       // ms, doubled after each failed attempt
+#define CONNECT_BACKOFF_THRESHOLD 2   // failed wakes before skipping connections
+#define CONNECT_BACKOFF_MAX_WAKES 64  // wakes
+#define SESSION_REFRESH_INTERVAL 100 // runs between 2 subscriptions in a persistent session
+#define CONFIG_ARENA_SIZE 4096       // bytes, static memory used to parse a config message
+
+#define RPC_QUEUE_SIZE 4              // requests answered per wake
+#define RPC_REQUEST_MAX_LENGTH 192    // bytes
+#define RPC_ID_MAX_LENGTH 16          // characters, with the terminating 0
+#define RPC_ARENA_SIZE 4096           // bytes, static memory used for a request and its response
+
 #define CLOSEST 200                   // mm
 #define FARTHEST 8000                 // mm
-#define SPEED_OF_SOUND 330            // m
+
+#define DEFAULT_TEMPERATURE 20        // C, air temperature in the tank
+#define SOUND_TABLE_MIN_TEMP -10      // C
+#define SOUND_TABLE_MAX_TEMP 50       // C
+#define USE_INTERNAL_TEMPERATURE 0    // Use the chip sensor instead of the configured temperature
+
+#define TRIGGER_SETTLE_US 10          // us, trigger low before the pulse
+#define TRIGGER_PULSE_US 2000         // us, the AJ-SR04M needs a long pulse in mode 2
+#define ECHO_TIMEOUT_US 60000         // us, longer than the flight time at FARTHEST
 
 #define BAT_ADC    2
 
 #define MSG_BUFFER_SIZE  (50)
 
+#define CONNECT_TASK_STACK_SIZE 8192
+#define CONNECT_TIMEOUT 45000         // ms, longest time to connect Wifi and MQTT
+
 // Number of probes
 #define PROBE_COUNT 2
 
 // Debug (not used)
 #define DEBUG true
 
-// GPIO mapping
-#define trigPin0 2
-#define echoPin0 4
-#define trigPin1 10
-#define echoPin1 7
+// GPIO mapping: Probe<trigger pin, echo pin, tank>
+typedef ProbeArray<
+    Probe<2, 4, 0>,
+    Probe<10, 7, 1>>
+    Probes;
 #define gndPin0 6
 
+static_assert(Probes::count == PROBE_COUNT, "PROBE_COUNT must match the number of probes in Probes");
+
 // Memory mapping
 #define SETTINGS_NAMESPACE "settings"
 
 // File logging config
-#define MAX_LOG_FILE_NUMBER 20
+#define MAX_LOG_FILE_NUMBER 20       // log file slots, written round-robin
+#define LOG_INDEX_FILE "/log.idx"     // sequence of the current log file
+#ifndef BASE_PATH                    // the tests mount a directory of the computer
 #define BASE_PATH "/littlefs"
+#endif
 #define MAX_OPEN_FILE 2U
 #define PARTITION_LABEL "storage"
+#define FILE_NAME_MAX_LENGTH 32
+#define FILE_CHUNK_SIZE 1024          // bytes of file data per MQTT message
+#define FILE_TRANSFER_TIME 2000       // ms, longest time spent sending a file on each wake
 
 // Water level mapping
 extern RTC_DATA_ATTR int minLevel[];
@@ -57,6 +106,9 @@ extern RTC_DATA_ATTR uint8_t  channel;
 extern RTC_DATA_ATTR uint8_t  bssid[6];
 extern RTC_DATA_ATTR uint32_t run;
 extern long wifiStart;
+extern uint8_t waterConfidence[];
+extern long waterLevel[];
+extern float batteryLevel;
 
 // Configuration
 extern RTC_DATA_ATTR uint64_t sleepTime;
@@ -66,6 +118,21 @@ extern RTC_DATA_ATTR uint8_t  maxDifference;
 extern RTC_DATA_ATTR bool     batteryAlertSent;
 extern RTC_DATA_ATTR bool     waterLevelAlertSent;
 extern RTC_DATA_ATTR uint8_t  logLevel;
+extern RTC_DATA_ATTR uint8_t  logLevelSerial;
+extern RTC_DATA_ATTR uint8_t  logLevelFile;
+extern RTC_DATA_ATTR uint8_t  logLevelMqtt;
+extern RTC_DATA_ATTR int8_t   temperature;
+extern RTC_DATA_ATTR uint8_t  burstSize;
+extern RTC_DATA_ATTR uint8_t  burstThreshold;
+extern RTC_DATA_ATTR uint8_t  batchSize;
+extern RTC_DATA_ATTR uint8_t  batchDepth;
+extern RTC_DATA_ATTR uint8_t  profileInterval;
+extern RTC_DATA_ATTR uint16_t reportDelta;
+extern RTC_DATA_ATTR uint16_t heartbeatInterval;
+extern RTC_DATA_ATTR uint8_t  telemetryFormat;
+extern RTC_DATA_ATTR uint8_t  persistentSession;
+extern RTC_DATA_ATTR bool     sessionSubscribed;
+extern RTC_DATA_ATTR uint16_t drainTimeout;
 
 extern WiFiClient espClient;
 extern PubSubClient client;
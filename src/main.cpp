@@ -36,6 +36,9 @@ RTC_DATA_ATTR uint16_t bufferPosition;
 RTC_DATA_ATTR uint8_t  logBuffer[1024];
 RTC_DATA_ATTR uint16_t logBufferLength;
 RTC_DATA_ATTR uint8_t  logLevel = LOG_LEVEL_NOTICE;
+RTC_DATA_ATTR uint8_t  logLevelSerial = LOG_LEVEL_VERBOSE;
+RTC_DATA_ATTR uint8_t  logLevelFile = LOG_LEVEL_VERBOSE;
+RTC_DATA_ATTR uint8_t  logLevelMqtt = LOG_LEVEL_VERBOSE;
 RTC_DATA_ATTR bool     rtcValid = false;
 RTC_DATA_ATTR uint32_t run = 0;
 
@@ -61,25 +64,42 @@ RTC_DATA_ATTR int      maxLevel[PROBE_COUNT];
 RTC_DATA_ATTR uint8_t  maxDifference;
 RTC_DATA_ATTR bool     batteryAlertSent = false;
 RTC_DATA_ATTR bool     waterLevelAlertSent = false;
+RTC_DATA_ATTR int8_t   temperature = DEFAULT_TEMPERATURE;
+RTC_DATA_ATTR uint8_t  burstSize = DEFAULT_BURST_SIZE;
+RTC_DATA_ATTR uint8_t  burstThreshold = DEFAULT_BURST_THRESHOLD;
+RTC_DATA_ATTR uint8_t  batchSize = DEFAULT_BATCH_SIZE;
+RTC_DATA_ATTR uint8_t  batchDepth = DEFAULT_BATCH_DEPTH;
+RTC_DATA_ATTR uint8_t  profileInterval = DEFAULT_PROFILE_INTERVAL;
+RTC_DATA_ATTR uint16_t reportDelta = DEFAULT_REPORT_DELTA;
+RTC_DATA_ATTR uint16_t heartbeatInterval = DEFAULT_HEARTBEAT_INTERVAL;
+RTC_DATA_ATTR uint8_t  telemetryFormat = TELEMETRY_TOPICS;
+RTC_DATA_ATTR uint8_t  persistentSession = 0;
+RTC_DATA_ATTR bool     sessionSubscribed = false;
+RTC_DATA_ATTR uint16_t drainTimeout = DEFAULT_DRAIN_TIMEOUT;
 
 long waterLevel[PROBE_COUNT];
+uint8_t waterConfidence[PROBE_COUNT];
 
 uint8_t lastFailedConnection = failedConnection;
 
 long wifiStart = 0;
 
-String LOG_TOPIC;
-
 bool removeConfigMsg = false;
+bool alertChanged = false;
+bool radioStarted = false;
 
 hw_timer_t *timer = NULL;
 TaskHandle_t xHandleReport = NULL;
+SemaphoreHandle_t connectDone = NULL;   // given by the connect task when it ends, or by the timer
 volatile bool timeoutFlag = false;
+volatile bool wifiConnected = false;
+volatile bool mqttConnected = false;
 
 /*--------------------------------------------------------------------------------*/
 
 void startSleep()
 {
+    profileStart(PHASE_SLEEP);
     Log.verboseln(F("Going to sleep"));
 
     uint64_t st = sleepTime;
@@ -94,11 +114,12 @@ void startSleep()
     Log.verboseln(F("MQTT Logging disabled"));
     delay(1);
 
-    size_t saved = mqttLog.saveBufferData(logBuffer);
+    size_t saved = mqttLog.saveBufferData(logBuffer, sizeof(logBuffer) - 1);
+    logBuffer[saved] = 0;
     logBufferLength = saved;
     Log.noticeln(F("Saved %l bytes to log buffer"), saved);
 
-    if (!timeoutFlag)
+    if (!timeoutFlag && radioStarted)
     {
         if (client.connected())
         {
@@ -136,22 +157,31 @@ void startSleep()
         fileLog.close();
         LittleFS.end();
     }
-    else
+    else if (timeoutFlag)
     {
         Log.warningln(F("Timeout flag set"));
     }
 
+    if (timeoutFlag || !radioStarted)
+    {
+        Log.verboseln(F("Closing file and filesystem"));
+        mp.removeOutput(&fileLog);
+        fileLog.close();
+        LittleFS.end();
+    }
+
     Log.verboseln(F("Keeping track on the run number"));
     run = ++run % 100000;
+    runChanged();
 
-    Preferences preferences;
-    if (preferences.begin(SETTINGS_NAMESPACE, false))
-    {
-        preferences.putUInt("run", run);
-        preferences.end();
-    }
+    // Write back the settings changed during this cycle
+    commitSettings();
+    sealSettings();
 
     rtcValid = true;
+    profileEnd(PHASE_SLEEP);
+    profileCycleEnd();
+    mp.flush();
     printTimestamp(&Serial);
     Serial.print("Going down for ");
     Serial.print(st / 1000);
@@ -176,98 +206,216 @@ void startSleep()
 
 void IRAM_ATTR onTimer()
 {
-    // Put ESP to sleep if not connected when timer expires
-    if (!WiFi.isConnected())
+    // Wifi not connected in time: wake report() up. Going to sleep writes to
+    // the NVS, which cannot be done from an interrupt.
+    if (!wifiConnected)
     {
-        vTaskSuspend(xHandleReport);
-        mp.removeOutput(&fileLog);
-        // Decrease log level to avoid timeouts
-        Log.setLevel(LOG_LEVEL_WARNING);
-        esp_log_level_set("*", ESP_LOG_WARN);
-        Log.warningln(F("WiFi connection timeout"));
-        timeoutFlag = true;
-        startSleep();
+        BaseType_t woken = pdFALSE;
+        xSemaphoreGiveFromISR(connectDone, &woken);
+        if (woken == pdTRUE)
+        {
+            portYIELD_FROM_ISR();
+        }
     }
 }
 
-void report()
+// Connects WiFi and MQTT while the probes are measuring
+void connectTask(void *parameter)
 {
+    profileStart(PHASE_WIFI);
+    wifiConnected = initWiFi();
+    profileEnd(PHASE_WIFI);
+
+    if (wifiConnected)
+    {
+        profileStart(PHASE_MQTT);
+        mqttConnected = reconnect();
+        profileEnd(PHASE_MQTT);
+    }
+    else
+    {
+        connectionDone(false, 0);
+    }
+
+    xHandleReport = NULL;
+    xSemaphoreGive(connectDone);
+    vTaskDelete(NULL);
+}
+
+void startConnection()
+{
+    if (radioStarted)
+    {
+        return;
+    }
+
     // Wifi needs 80+ MHz to work
     if (getCpuFrequencyMhz() < 80)
     {
         setCpuFrequencyMhz(80);
     }
 
-    if (!initWiFi())
+    connectDone = xSemaphoreCreateBinary();
+
+    // Initialize timer (40MHz clock, prescaler 40 = 1MHz, count up)
+    timer = timerBegin(0, 40, true);
+    timerAttachInterrupt(timer, &onTimer, false);
+    // Alarm after CONNECT_TIMEOUT (in us)
+    timerAlarmWrite(timer, CONNECT_TIMEOUT * 1000ULL, false);
+    timerAlarmEnable(timer);
+
+    radioStarted = true;
+    xTaskCreate(connectTask, "connect", CONNECT_TASK_STACK_SIZE, NULL, uxTaskPriorityGet(NULL), &xHandleReport);
+}
+
+void report()
+{
+    startConnection();
+
+    // Wait for the connection started in parallel with the measures. Not on a
+    // task notification: the echo capture uses the ones of this task. The
+    // connect timer also gives the semaphore, while the task is still running.
+    xSemaphoreTake(connectDone, pdMS_TO_TICKS(CONNECT_TIMEOUT));
+    if (xHandleReport != NULL)
+    {
+        vTaskSuspend(xHandleReport);
+        Log.warningln(F("Connection not done after %d ms"), CONNECT_TIMEOUT);
+        connectionDone(false, 0);
+        // The client may be in use by the suspended task
+        mqttLog.setSuspend(true);
+        timeoutFlag = true;
+        startSleep();
+    }
+
+    if (!wifiConnected)
     {
         startSleep();
     }
 
-    if (reconnect())
+    if (mqttConnected)
     {
         if (lastFailedConnection > 0)
         {
-            fileGet(fileLog.getLastLogFileName());
+            String lastLog = fileLog.getLastLogFileName();
+            fileGet(lastLog.c_str(), lastLog.length());
         }
 
         // MQTT connection succeeded
+        profileStart(PHASE_PUBLISH);
         mqttLog.setSuspend(false);
         client.loop();
 
-        for (int i = 0; i < PROBE_COUNT; i++)
+        if (telemetryFormat != TELEMETRY_TOPICS)
         {
-            if (waterLevel[i] < CLOSEST || waterLevel[i] > FARTHEST)
+            // All the values in a single message
+            telemetryPublish(waterLevel, batteryLevel, WiFi.RSSI());
+        }
+        else
+        {
+            char value[16];
+            for (int i = 0; i < PROBE_COUNT; i++)
             {
-                Log.warningln(F("Not reporting the measurement %d as it is invalid"), i);
-                continue;
+                if (waterLevel[i] < CLOSEST || waterLevel[i] > FARTHEST)
+                {
+                    Log.warningln(F("Not reporting the measurement %d as it is invalid"), i);
+                    continue;
+                }
+
+                // compute percentage of filled volume
+                float filledLevel = (minLevel[i] - waterLevel[i] * 1.0) / (minLevel[i] - maxLevel[i]) * 100;
+                snprintf(value, sizeof(value), "%ld", waterLevel[i]);
+                client.publish(getTopic(TOPIC_LEVEL + i), value, true);
+                snprintf(value, sizeof(value), "%.2f", filledLevel);
+                client.publish(getTopic(TOPIC_LEVEL_PERCENTAGE + i), value, true);
             }
 
-            // compute percentage of filled volume
-            float filledLevel = (minLevel[i] - waterLevel[i] * 1.0) / (minLevel[i] - maxLevel[i]) * 100;
-            client.publish((ROOT_TOPIC + "/level" + String(i)).c_str(), (String(waterLevel[i])).c_str(), true);
-            client.publish((ROOT_TOPIC + "/level" + String(i) + "Percentage").c_str(), (String(filledLevel)).c_str(), true);
+            // Reporting voltage
+            snprintf(value, sizeof(value), "%.2f", batteryLevel);
+            client.publish(getTopic(TOPIC_VOLTAGE), value, true);
+            client.publish(getTopic(TOPIC_AVAILABILITY), "online", false);
         }
 
-        // Reporting voltage
-        client.publish((ROOT_TOPIC + "/voltage").c_str(), (String(batteryLevel)).c_str(), true);
-        client.publish((ROOT_TOPIC + "/availability").c_str(), "online", false);
+        // Reporting battery alert
+        if (alertChanged && batteryAlertSent)
+        {
+            client.publish(getTopic(TOPIC_ALERT), "Battery low");
+        }
+        else if (alertChanged)
+        {
+            // Clear alert
+            client.publish(getTopic(TOPIC_ALERT), NULL, 0, true);
+        }
+
+        // Reporting buffered readings
+        if (batchPublish())
+        {
+            batchReported(waterLevel, batteryLevel);
+        }
+
+        // Reporting wake cycle timings
+        profilePublish();
+
+        // Describing the settings after a cold boot
+        schemaPublish();
         client.loop();
+        profileEnd(PHASE_PUBLISH);
         Log.noticeln(F("Measurements sent"));
 
-        // Make sure that buffered messages got sent
-        mqttLog.setSuspend(false);
-        delay(1);
-        client.loop();
+        // Receive the pending messages until the broker echoes our marker, which
+        // it sends after everything queued before it
+        profileStart(PHASE_DRAIN);
+        unsigned long deadline = millis() + drainTimeout;
+        bool synced = mqttSync(deadline);
 
-        // Empty Wifi reception buffer
-        while (espClient.available())
+        // Answering the requests received so far, all in a row, then sending the
+        // requested file. The rest of the file goes on the next wake.
+        bool answered = rpcProcess();
+        if (fileTransferPending())
         {
-            mqttLog.setSuspend(false);
-            delay(1);
-            client.loop();
+            fileTransferContinue(millis() + FILE_TRANSFER_TIME);
+            answered = true;
         }
 
-        while (callback_running)
+        if (answered)
         {
-            delay(1);
+            deadline = millis() + drainTimeout;
+            synced = mqttSync(deadline);
         }
 
-        if (removeConfigMsg)
+        // Commands of a persistent session are not retained, nothing to remove
+        if (removeConfigMsg && !persistentSession)
         {
             // This config message is intended for me only so I can delete it
             Log.noticeln(F("Config message processed"));
-            client.publish((ROOT_TOPIC + "/config").c_str(), new byte[0], 0, true);
-            delay(1);
-            client.loop();
+            client.publish(getTopic(TOPIC_CONFIG), NULL, 0, true);
+
+            // Make sure the broker got it before disconnecting
+            deadline = millis() + drainTimeout;
+            synced = mqttSync(deadline);
             Log.traceln("Message removed from topic");
-            delay(10);
-            client.loop();
         }
+        profileEnd(PHASE_DRAIN);
 
-        // Preparing for sleep
-        client.unsubscribe((ROOT_TOPIC + "/config").c_str());
+        if (!synced)
+        {
+            profileDrainTimeout();
+        }
+
+        // Preparing for sleep. A persistent session keeps its subscriptions
+        if (!persistentSession)
+        {
+            client.unsubscribe(getTopic(TOPIC_CONFIG));
+        }
+        // Sending the log of this wake while connected
+        mp.flush();
         client.disconnect();
-        delay(5);
+
+        if (rpcRestartRequested())
+        {
+            Log.noticeln(F("Restarting"));
+            commitSettings();
+            ESP.restart();
+        }
     }
 
     startSleep();
@@ -275,6 +423,7 @@ void report()
 
 void setup()
 {
+    profileRecord(PHASE_BOOT, (uint32_t)esp_timer_get_time());
 
     /***********************************
      *     Initialisation
@@ -297,17 +446,7 @@ void setup()
     digitalWrite(gndPin0, LOW);
     digitalWrite(5, LOW);
 
-#if PROBE_COUNT >= 1
-    pinMode(trigPin0, OUTPUT);
-    pinMode(echoPin0, INPUT);
-    digitalWrite(trigPin0, LOW);
-#endif
-
-#if PROBE_COUNT >= 2
-    pinMode(trigPin1, OUTPUT);
-    pinMode(echoPin1, INPUT);
-    digitalWrite(trigPin1, LOW);
-#endif
+    Probes::init();
 
 #if DEBUG
     while (!Serial)
@@ -322,8 +461,8 @@ void setup()
     esp_log_level_set("*", ESP_LOG_VERBOSE);
 #endif
 
-    LOG_TOPIC = ROOT_TOPIC + "/log";
-    mqttLog = PubSubPrint(&client, LOG_TOPIC.c_str());
+    initTopics();
+    mqttLog = PubSubPrint(&client, getTopic(TOPIC_LOG));
     mqttLog.setSuspend(true);
     size_t loaded = mqttLog.loadBufferData(logBuffer, logBufferLength);
 
@@ -333,115 +472,65 @@ void setup()
         Log.warningln(F("MultiPrint instance improperly set"));
         mp.instance = &mp;
     }
-    mp.addOutput(&Serial);
+    // logLevel is the most verbose level logged, each output can log less
+    mp.addOutput(&Serial, LOG_SINK_DROP, &logLevelSerial);
     Log.begin(logLevel, &mp);
-    // Comment next line if you don’t want logging by MQTT
-    mp.addOutput(&mqttLog);
-
-    // Check if any formatting is needed
-    Preferences preferences;
-    if (!preferences.begin(SETTINGS_NAMESPACE, false))
-    {
-        Log.errorln(F("Unable to read preferences. Rebooting"));
-        ESP.restart();
-    }
-
-    if (!preferences.isKey("init"))
-    {
-        Log.warningln(F("First start"));
-        preferences.end();
-        nvs_flash_erase(); // erase the NVS partition and...
-        nvs_flash_init();  // initialize the NVS partition.
-        esp_littlefs_format(PARTITION_LABEL);
-        preferences.begin(SETTINGS_NAMESPACE, false);
-        preferences.putBool("init", true);
-    }
-
-    fileLog = FilePrint();
-    mp.addOutput(&fileLog);
-    if (preferences.isKey("logLevel"))
+    binaryLogWake(run);
+    if (!mp.begin())
     {
-        logLevel = preferences.getUShort("logLevel", LOG_LEVEL_NOTICE);
-        Log.verboseln(F("Reading log level from Flash: %d"), logLevel);
-    } else {
-        Log.warningln(F("No log level found in Flash"));
+        Log.warningln(F("Log dispatcher not started, logging synchronously"));
     }
-    Log.setLevel(logLevel);
-    esp_log_level_set("*", (esp_log_level_t) (logLevel == 0 ? 0 : logLevel - 1));
-
-    Log.traceln(F("Logging ready"));
-    Log.noticeln(F("Loaded %l bytes from log buffer"), loaded);
-
-    // Read config from Flash
-    for (int i = 0; i < PROBE_COUNT; i++)
-    {
-        minLevel[i] = preferences.getInt(String("minLevel-" + i).c_str(), CLOSEST);
-        maxLevel[i] = preferences.getInt(String("maxLevel-" + i).c_str(), FARTHEST);
-    }
-    // Sleep time
-    sleepTime = preferences.getULong64("sleepTime", DEFAULT_SLEEP_TIME);
-
-    // Sleep time on power
-    sleepTimeOnPower = preferences.getULong64("sleepTimeOnPow", DEFAULT_SLEEP_TIME);
-    onPowerThreshold = preferences.getFloat("onPowerThresh", BATTERY_ON_POWER_THRESHOLD);
-
-    // Max difference
-    maxDifference = preferences.getUShort("maxDifference", DEFAULT_MAX_DIFFERENCE);
+    // Comment next line if you don’t want logging by MQTT
+    mp.addOutput(&mqttLog, LOG_SINK_BLOCK, &logLevelMqtt);
 
-    // Checking the recorded value (should only be useful on the first start)
-    if (isnan(sleepTime) || sleepTime <= 0)
-    {
-        sleepTime = DEFAULT_SLEEP_TIME;
-        preferences.putULong64("sleepTime", DEFAULT_SLEEP_TIME);
-        Log.warningln(F("Set default sleep time"));
-    }
-    Log.noticeln(F("Sleep time %i s"), (int)(sleepTime / 1e6));
+    // The settings kept in RTC memory are used as long as they are valid
+    bool warmBoot = settingsValid();
+    Preferences preferences;
 
-    for (int i = 0; i < PROBE_COUNT; i++)
+    if (!warmBoot)
     {
-        if (minLevel[i] < CLOSEST || minLevel[i] > FARTHEST)
+        // Check if any formatting is needed
+        if (!preferences.begin(SETTINGS_NAMESPACE, false))
         {
-            Log.warningln(F("minLevel[%d] incorrect: %d. Resetting to default"), i, minLevel[i]);
-            minLevel[i] = CLOSEST;
-            preferences.putInt(String("minLevel-" + i).c_str(), minLevel[i]);
+            Log.errorln(F("Unable to read preferences. Rebooting"));
+            ESP.restart();
         }
 
-        if (maxLevel[i] < CLOSEST || maxLevel[i] > FARTHEST)
+        if (!preferences.isKey("init"))
         {
-            Log.warningln(F("maxLevel[%d] incorrect: %d. Resetting to default"), i, maxLevel[i]);
-            maxLevel[i] = FARTHEST;
-            preferences.putInt(String("maxLevel-" + i).c_str(), maxLevel[i]);
+            Log.warningln(F("First start"));
+            preferences.end();
+            nvs_flash_erase(); // erase the NVS partition and...
+            nvs_flash_init();  // initialize the NVS partition.
+            esp_littlefs_format(PARTITION_LABEL);
+            preferences.begin(SETTINGS_NAMESPACE, false);
+            preferences.putBool("init", true);
         }
-
-        if (minLevel[i] == maxLevel[i])
-        {
-            Log.warningln(F("minLevel[%d] and maxLevel[%d] are the same: %d. Resetting to default"), i, i, maxLevel[i]);
-            minLevel[i] = CLOSEST;
-            maxLevel[i] = FARTHEST;
-            preferences.putInt(String("minLevel-" + i).c_str(), minLevel[i]);
-            preferences.putInt(String("maxLevel-" + i).c_str(), maxLevel[i]);
-        }
-
-        Log.noticeln(F("Levels[%d]: %d (deepest) - %d (highest)"), i, minLevel[i], maxLevel[i]);
     }
 
-    if (isnan(maxDifference) || maxDifference == 0 || maxDifference > 1000)
+    profileStart(PHASE_FS_MOUNT);
+    fileLog.begin();
+    profileEnd(PHASE_FS_MOUNT);
+    mp.addOutput(&fileLog, LOG_SINK_BLOCK, &logLevelFile);
+    // The errors are written to the flash at once, in case the device resets
+    mp.setFlushLevel(&fileLog, LOG_LEVEL_ERROR);
+
+    if (!warmBoot)
     {
-        Log.warningln(F("Set default max difference"));
-        maxDifference = DEFAULT_MAX_DIFFERENCE;
-        preferences.putUShort("maxDifference", maxDifference);
+        Log.noticeln(F("Loading settings from Flash"));
+        profileStart(PHASE_NVS);
+        loadSettings(preferences);
+        profileEnd(PHASE_NVS);
+        preferences.end();
     }
-
-    if (run == 0)
+    else
     {
-        Log.noticeln(F("Reading run from Flash"));
-        if (preferences.isKey("run"))
-        {
-            run = preferences.getUInt("run", 0);
-        }
+        Log.verboseln(F("Settings loaded from RTC memory (%l us saved)"), configLoadSaved);
     }
+    logLevelChanged();
 
-    preferences.end();
+    Log.traceln(F("Logging ready"));
+    Log.noticeln(F("Loaded %l bytes from log buffer"), loaded);
 
     Log.traceln(F("RTC Data:"));
     Log.traceln(F(" - rtcValid: %T"), rtcValid);
@@ -450,6 +539,7 @@ void setup()
     Log.traceln(F(" - failedConnection: %d"), failedConnection);
     Log.traceln(F(" - waterLevelAlertSent: %d"), waterLevelAlertSent);
     Log.traceln(F(" - logLevel: %d"), logLevel);
+    Log.traceln(F(" - buffered readings: %d"), batchCount());
     Log.traceln(F(" - bufferPosition: %d"), bufferPosition);
     Log.traceln(F(" - logBuffer: %s"), logBuffer);
 
@@ -458,51 +548,71 @@ void setup()
      */
 
     // Read the battery level
+    profileStart(PHASE_BATTERY);
     batteryLevel = getVoltage();
+    profileEnd(PHASE_BATTERY);
     Log.traceln(F("Battery voltage = %F V"), batteryLevel);
 
     // sends alert if battery low
     if (batteryLevel <= BATTERY_ALERT_THRESHOLD)
     {
         Log.warningln("Battery low!");
-        client.publish((ROOT_TOPIC + "/alert").c_str(), "Battery low");
+        alertChanged = !batteryAlertSent;
         batteryAlertSent = true;
     }
     else if (batteryAlertSent && batteryLevel > BATTERY_ALERT_REARM)
     {
         // Clear alert
         batteryAlertSent = false;
-        client.publish((ROOT_TOPIC + "/alert").c_str(), new byte[0], 0, true);
+        alertChanged = true;
     }
 
-#if PROBE_COUNT >= 1
-    waterLevel[0] = getWaterLevel(trigPin0, echoPin0, 0);
-    if (waterLevel[0] > 0)
+    // Start connecting right away when a report is due, so that Wifi association
+    // overlaps the measures
+    bool reportDue = batchDue(alertChanged);
+    bool connectionOk = connectionAllowed(alertChanged);
+    if (reportDue && connectionOk)
     {
-        lastMeasure[0] = waterLevel[0];
+        startConnection();
     }
-#endif
 
-#if PROBE_COUNT >= 2
-    waterLevel[1] = getWaterLevel(trigPin1, echoPin1, 1);
-    if (waterLevel[1] > 0)
+    Probes::measure([](uint8_t i, uint8_t trigPin, uint8_t echoPin) {
+        profileStart(PHASE_PROBE + i);
+        waterLevel[i] = getWaterLevel(trigPin, echoPin, i);
+        profileEnd(PHASE_PROBE + i);
+        if (waterLevel[i] > 0)
+        {
+            lastMeasure[i] = waterLevel[i];
+        }
+    });
+
+    for (int i = 0; i < PROBE_COUNT; i++)
     {
-        lastMeasure[1] = waterLevel[1];
+        batchAdd(i, waterLevel[i]);
+    }
+
+    // Report by exception: levels or voltage changed since the last report
+    if (!reportDue && levelsChanged(waterLevel, batteryLevel))
+    {
+        reportDue = true;
+    }
+
+    // Backing off after failed connections: the readings stay buffered
+    if (!connectionOk)
+    {
+        reportDue = false;
+    }
+
+    if (!reportDue)
+    {
+        Log.noticeln(F("%d readings buffered. Skipping report"), batchCount());
+        startSleep();
     }
-#endif
 
     /***********************************
      *     Reporting
      */
 
-    // Initialize timer (40MHz clock, prescaler 40 = 1MHz, count up)
-    timer = timerBegin(0, 40, true);
-    timerAttachInterrupt(timer, &onTimer, false);
-    // Set timer for 45 seconds (45,000,000 microseconds)
-    timerAlarmWrite(timer, 45000000, false);
-    timerAlarmEnable(timer);
-    // Init WiFi (as late as possible to save power)
-
     report();
 }
 
@@ -3,7 +3,7 @@
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
-#include <ArduinoLog.h>
+#include "LogFloor.h"
 #include "MultiPrint.h"
 #include "PubSubPrint.h"
 #include "FilePrint.h"
@@ -13,6 +13,13 @@
 #include "measure.h"
 #include "PrintUtils.h"
 #include "Wifi.h"
+#include "batch.h"
+#include "settings.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include "topics.h"
+#include <esp_timer.h>
+#include <esp_ota_ops.h>
 #include <LittleFS.h>
 #include "esp_littlefs.h"
 #include <FS.h>
@@ -1,4 +1,68 @@
 #include "measure.h"
+#include <esp_timer.h>
+
+/******************\
+ * Speed of sound *
+\******************/
+
+// c = 331.3 * sqrt(1 + T / 273.15) m/s
+
+// Newton iterations, only evaluated by the compiler
+constexpr double soundSqrt(double x, double guess = 1.0, int i = 0)
+{
+    return i == 16 ? guess : soundSqrt(x, (guess + x / guess) / 2, i + 1);
+}
+
+// Distance per microsecond of echo, go and back, in mm with 16 fractional bits
+constexpr uint16_t soundFactor(int temp)
+{
+    return (uint16_t)(331.3 * soundSqrt(1.0 + temp / 273.15) / 2000.0 * 65536.0 + 0.5);
+}
+
+#define SOUND_DECADE(t) soundFactor(t),     soundFactor(t + 1), soundFactor(t + 2), soundFactor(t + 3), \
+                        soundFactor(t + 4), soundFactor(t + 5), soundFactor(t + 6), soundFactor(t + 7), \
+                        soundFactor(t + 8), soundFactor(t + 9)
+
+// One entry per degree from SOUND_TABLE_MIN_TEMP to SOUND_TABLE_MAX_TEMP
+static constexpr uint16_t SOUND_FACTOR[] = {
+    SOUND_DECADE(-10), SOUND_DECADE(0), SOUND_DECADE(10), SOUND_DECADE(20),
+    SOUND_DECADE(30), SOUND_DECADE(40), soundFactor(50)};
+
+static_assert(sizeof(SOUND_FACTOR) / sizeof(SOUND_FACTOR[0]) == SOUND_TABLE_MAX_TEMP - SOUND_TABLE_MIN_TEMP + 1,
+              "Speed of sound table does not match its temperature range");
+// Reference values from the formula above
+static_assert(SOUND_FACTOR[0 - SOUND_TABLE_MIN_TEMP] == 10856, "Wrong speed of sound at 0 C");
+static_assert(SOUND_FACTOR[20 - SOUND_TABLE_MIN_TEMP] == 11246, "Wrong speed of sound at 20 C");
+static_assert(SOUND_FACTOR[40 - SOUND_TABLE_MIN_TEMP] == 11624, "Wrong speed of sound at 40 C");
+
+int8_t getTemperature()
+{
+#if USE_INTERNAL_TEMPERATURE
+    // The chip is still close to ambient temperature before Wifi starts
+    return (int8_t)temperatureRead();
+#else
+    return temperature;
+#endif
+}
+
+uint32_t echoToDistance(uint32_t width, int8_t temp)
+{
+    if (temp < SOUND_TABLE_MIN_TEMP)
+    {
+        temp = SOUND_TABLE_MIN_TEMP;
+    }
+    if (temp > SOUND_TABLE_MAX_TEMP)
+    {
+        temp = SOUND_TABLE_MAX_TEMP;
+    }
+
+    return (width * SOUND_FACTOR[temp - SOUND_TABLE_MIN_TEMP] + 0x8000) >> 16;
+}
+
+// Echo edges captured by interrupt
+static volatile int64_t      echoStart = 0;
+static volatile int64_t      echoEnd = 0;
+static volatile TaskHandle_t echoTask = NULL;
 
 float getVoltage()
 {
@@ -8,25 +72,89 @@ float getVoltage()
     return floatVoltage;
 }
 
-int getWaterReading(uint8_t trigPin, uint8_t echoPin)
+void IRAM_ATTR onEchoEdge()
 {
-    long duration;     // variable for the duration of sound wave travel
-    int distance = -1; // variable for the distance measurement
+    int64_t now = esp_timer_get_time();
+
+    // The echo line is low when triggering so the first edge is the rising one
+    if (echoStart == 0)
+    {
+        echoStart = now;
+        return;
+    }
+
+    if (echoEnd == 0)
+    {
+        echoEnd = now;
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(echoTask, &woken);
+        if (woken)
+        {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+EchoCapture captureEcho(uint8_t trigPin, uint8_t echoPin)
+{
+    EchoCapture capture = {0, ECHO_OK};
 
-    // Sets the trigPin HIGH (ACTIVE) for 10 microseconds
-    Log.traceln("Triggering on port %u and listening echo on port %u", trigPin, echoPin);
     pinMode(trigPin, OUTPUT);
     pinMode(echoPin, INPUT);
-    digitalWrite(trigPin, LOW); //
-    delay(10);
+    digitalWrite(trigPin, LOW);
+
+    if (digitalRead(echoPin) == HIGH)
+    {
+        capture.quality = ECHO_BUSY;
+        return capture;
+    }
+
+    echoStart = 0;
+    echoEnd = 0;
+    echoTask = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0); // Clear any pending notification
+    attachInterrupt(digitalPinToInterrupt(echoPin), onEchoEdge, CHANGE);
+
+    delayMicroseconds(TRIGGER_SETTLE_US);
     digitalWrite(trigPin, HIGH);
-    delay(2);
+    delayMicroseconds(TRIGGER_PULSE_US);
     digitalWrite(trigPin, LOW);
-    delay(1);
-    // Reads the echoPin, returns the sound wave travel time in microseconds
-    duration = pulseIn(echoPin, HIGH, 50000);
+
+    // Sleep until the end of the echo so the core can idle during the flight time
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ECHO_TIMEOUT_US / 1000 + 1));
+    detachInterrupt(digitalPinToInterrupt(echoPin));
+
+    if (echoStart == 0)
+    {
+        capture.quality = ECHO_NO_ECHO;
+    }
+    else if (echoEnd == 0)
+    {
+        capture.quality = ECHO_NO_END;
+    }
+    else
+    {
+        capture.width = (uint32_t)(echoEnd - echoStart);
+    }
+
+    return capture;
+}
+
+int getWaterReading(uint8_t trigPin, uint8_t echoPin)
+{
+    int distance = -1; // variable for the distance measurement
+
+    Log.traceln("Triggering on port %u and listening echo on port %u", trigPin, echoPin);
+    EchoCapture capture = captureEcho(trigPin, echoPin);
+
+    if (capture.quality != ECHO_OK)
+    {
+        Log.verboseln(F("No valid echo on port %u (quality %d)"), echoPin, capture.quality);
+        return -1;
+    }
+
     // Calculating the distance
-    distance = duration * 0.34 / 2; // Speed of sound wave divided by 2 (go and back)
+    distance = echoToDistance(capture.width, getTemperature());
 
     if (distance <= 0)
     {
@@ -38,93 +166,163 @@ int getWaterReading(uint8_t trigPin, uint8_t echoPin)
     return distance;
 }
 
-int getWaterLevel(uint8_t trigPin, uint8_t echoPin, uint8_t index)
+// Sorts a small array in place (insertion sort, no allocation)
+static void sortSamples(int16_t *samples, uint8_t count)
+{
+    for (uint8_t i = 1; i < count; i++)
+    {
+        int16_t value = samples[i];
+        int8_t j = i - 1;
+        while (j >= 0 && samples[j] > value)
+        {
+            samples[j + 1] = samples[j];
+            j--;
+        }
+        samples[j + 1] = value;
+    }
+}
+
+// Median of a sorted array
+static int16_t medianOf(const int16_t *sorted, uint8_t count)
+{
+    if (count % 2 == 1)
+    {
+        return sorted[count / 2];
+    }
+    return (sorted[count / 2 - 1] + sorted[count / 2] + 1) / 2;
+}
+
+BurstEstimate estimateDistance(int16_t *samples, uint8_t count, uint8_t requested)
 {
+    BurstEstimate estimate = {-1, 0};
 
-    int distance = getWaterReading(trigPin, echoPin);
+    if (count == 0)
+    {
+        return estimate;
+    }
 
-    // Check that returned value makes sense
+    sortSamples(samples, count);
+    int16_t median = medianOf(samples, count);
 
-    int i = 0;
-    // Check reading plausibility
-    while ((distance < CLOSEST || abs(distance - lastMeasure[index]) > maxDifference) && i < 4)
+    // Median absolute deviation
+    int16_t deviation[MAX_BURST_SIZE];
+    for (uint8_t i = 0; i < count; i++)
     {
+        deviation[i] = abs(samples[i] - median);
+    }
+    sortSamples(deviation, count);
+    int16_t mad = medianOf(deviation, count);
 
-        if (distance < CLOSEST)
-        {
-            Log.warningln("Distance too short for the sensor %d. Trying again.", index);
-        }
+    // Samples further than threshold * MAD from the median are outliers
+    int32_t limit = ((int32_t)mad * burstThreshold + 5) / 10;
+    if (limit < BURST_MIN_SPREAD)
+    {
+        limit = BURST_MIN_SPREAD;
+    }
+    if (limit > maxDifference)
+    {
+        limit = maxDifference;
+    }
 
-        if (distance >= CLOSEST && abs(distance - lastMeasure[index]) > maxDifference)
+    int32_t sum = 0;
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (abs(samples[i] - median) <= limit)
         {
-            Log.warningln("There is more than %dmm difference with last measure (was %dmm compared to %dmm now). Trying again", maxDifference, lastMeasure[index], distance);
-            lastMeasure[index] = (uint16_t)distance;
+            sum += samples[i];
+            kept++;
         }
+    }
 
-        delay(random(20, 100));
-        distance = getWaterReading(trigPin, echoPin);
+    // An even burst split in 2 groups has no reading near the median
+    if (kept == 0)
+    {
+        return estimate;
+    }
+
+    estimate.distance = (sum + kept / 2) / kept;
+    estimate.confidence = (uint8_t)((uint16_t)kept * 100 / requested);
+    return estimate;
+}
+
+int getWaterLevel(uint8_t trigPin, uint8_t echoPin, uint8_t index)
+{
+    int16_t samples[MAX_BURST_SIZE];
+    uint8_t count = 0;
 
-        if (distance < 0)
+    // Take a burst of readings, keeping only the ones in the sensor range
+    for (uint8_t i = 0; i < burstSize; i++)
+    {
+        if (i > 0)
         {
-            Log.errorln(F("Error reading water level %d: No value returned"), index);
+            delay(BURST_INTERVAL_MS);
         }
 
-        i++;
+        int reading = getWaterReading(trigPin, echoPin);
+        if (reading < CLOSEST || reading > FARTHEST)
+        {
+            Log.verboseln(F("Reading %d of probe %d out of range: %d mm"), i, index, reading);
+            continue;
+        }
+        samples[count++] = reading;
     }
 
-    if (distance < CLOSEST)
+    BurstEstimate estimate = estimateDistance(samples, count, burstSize);
+    waterConfidence[index] = estimate.confidence;
+    int distance = estimate.distance;
+
+    if (distance < 0)
     {
+        Log.errorln(F("Error reading water level %d: No value returned"), index);
         return -1;
     }
 
-    if (abs(distance - lastMeasure[index]) > maxDifference)
+    if (estimate.confidence < BURST_MIN_CONFIDENCE)
     {
-        Log.warningln(F("Distance not stabilising. Giving up"));
+        Log.warningln(F("Distance not stabilising on probe %d (%d mm, confidence %d%%). Giving up"), index, distance, estimate.confidence);
         return -1;
     }
 
+    Log.verboseln(F("Probe %d: %d of %d readings kept, confidence %d%%"), index, count, burstSize, estimate.confidence);
     Log.noticeln("Distance %d: %d mm", index, distance);
 
-    Preferences preferences;
-    if (preferences.begin(SETTINGS_NAMESPACE, false)) {
-        // Check that configuration values are correct
-        if (distance > minLevel[index])
-        {
-            Log.warningln("Measured water level is lower than minimum configured level. Adapting setting probe %d to %d.", index, distance);
-            // minimum level is lower than expected
-            minLevel[index] = distance;
-            preferences.putInt(String("minLevel-" + index).c_str(), distance);
-        }
+    // Check that configuration values are correct
+    if (distance > minLevel[index])
+    {
+        Log.warningln("Measured water level is lower than minimum configured level. Adapting setting probe %d to %d.", index, distance);
+        // minimum level is lower than expected
+        minLevel[index] = distance;
+        settingChanged(SETTING_MIN_LEVEL + index);
+    }
 
-        if (minLevel[index] > FARTHEST)
-        {
-            Log.warningln(F("Min level too far. Setting probe %d to %d mm"), index, FARTHEST);
-            preferences.putInt(String("minLevel-" + index).c_str(), FARTHEST);
-        }
+    if (minLevel[index] > FARTHEST)
+    {
+        Log.warningln(F("Min level too far. Setting probe %d to %d mm"), index, FARTHEST);
+        minLevel[index] = FARTHEST;
+        settingChanged(SETTING_MIN_LEVEL + index);
+    }
 
-        if (distance < maxLevel[index])
-        {
-            Log.warningln("Measured water level is higher than maximum configured level. Adapting setting probe %d to %d.", index, distance);
-            // maximum level is higher than expected
-            maxLevel[index] = distance;
-            preferences.putInt(String("maxLevel-" + index).c_str(), distance);
-        }
+    if (distance < maxLevel[index])
+    {
+        Log.warningln("Measured water level is higher than maximum configured level. Adapting setting probe %d to %d.", index, distance);
+        // maximum level is higher than expected
+        maxLevel[index] = distance;
+        settingChanged(SETTING_MAX_LEVEL + index);
+    }
 
-        if (maxLevel[index] < CLOSEST)
-        {
-            Log.warningln(F("Max level too close. Setting probe %d to %d mm"), index, CLOSEST);
-            preferences.putInt(String("maxLevel-" + index).c_str(), CLOSEST);
-        }
+    if (maxLevel[index] < CLOSEST)
+    {
+        Log.warningln(F("Max level too close. Setting probe %d to %d mm"), index, CLOSEST);
+        maxLevel[index] = CLOSEST;
+        settingChanged(SETTING_MAX_LEVEL + index);
+    }
 
-        if (minLevel[index] == maxLevel[index])
-        {
-            minLevel[index] = maxLevel[index] + 1;
-            Log.warningln(F("Min and max levels are the same on probe %d. Min set to %d mm"), index, minLevel[index]);
-            preferences.putInt(String("minLevel-" + index).c_str(), minLevel[index]);
-        }
-        preferences.end();
-    } else {
-        Log.errorln(F("Error opening preferences"));
+    if (minLevel[index] == maxLevel[index])
+    {
+        minLevel[index] = maxLevel[index] + 1;
+        Log.warningln(F("Min and max levels are the same on probe %d. Min set to %d mm"), index, minLevel[index]);
+        settingChanged(SETTING_MIN_LEVEL + index);
     }
 
     return distance;
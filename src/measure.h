@@ -1,8 +1,29 @@
 #include "Arduino.h"
 #include "global_vars.h"
-#include <ArduinoLog.h>
-#include <Preferences.h>
+#include "LogFloor.h"
+#include "settings.h"
+
+// Echo capture quality
+#define ECHO_OK        0 // Complete echo pulse received
+#define ECHO_BUSY      1 // Echo line already high when triggering
+#define ECHO_NO_ECHO   2 // No echo received before the timeout
+#define ECHO_NO_END    3 // Echo started but did not end before the timeout
+
+struct EchoCapture {
+    uint32_t width;   // us
+    uint8_t  quality;
+};
+
+// Result of a burst of readings
+struct BurstEstimate {
+    int     distance;   // mm, -1 if no reading
+    uint8_t confidence; // %, share of the requested readings kept
+};
 
 float getVoltage();
+int8_t getTemperature();
+uint32_t echoToDistance(uint32_t width, int8_t temp);
+EchoCapture captureEcho(uint8_t trigPin, uint8_t echoPin);
 int getWaterReading(uint8_t trigPin, uint8_t echoPin);
+BurstEstimate estimateDistance(int16_t *samples, uint8_t count, uint8_t requested);
 int getWaterLevel(uint8_t trigPin, uint8_t echoPin, uint8_t index);
\ No newline at end of file
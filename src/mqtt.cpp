@@ -1,272 +1,61 @@
 #include "mqtt.h"
-#include <base64.h>
+#include "ota.h"
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
 
 extern bool removeConfigMsg;
 
+// Marker of the last sync request and whether the broker sent it back
+static char syncMarker[16];
+static volatile bool syncReceived = false;
+
+// File transfer in progress, kept across sleeps to resume it
+RTC_DATA_ATTR FileTransfer fileTransfer;
+
+// Chunk read from the file and sent as is
+static struct __attribute__((packed)) {
+    FileChunkHeader header;
+    uint8_t         data[FILE_CHUNK_SIZE];
+} fileChunk;
+
 
 /********\
  * MQTT *
 \********/
 
-void configMsg(String topic, String payload)
+void configMsg(const char *payload, unsigned int length)
 {
 
     /* Process the configuration command */
 
-    // Allocate the JSON document
-    JsonDocument doc;
-
-    // Parse JSON object
-    DeserializationError error = deserializeJson(doc, payload);
-    if (error)
+    if (configParse(payload, length) < 0)
     {
-        Log.errorln(F("deserializeJson() failed: %s"), error.c_str());
         return;
     }
 
-    JsonObject conf = doc.as<JsonObject>();
-
-    Log.traceln(F("Number of keypairs: %d"), conf.size());
-
-    Preferences preferences;
-    if (!preferences.begin(SETTINGS_NAMESPACE, false))
-    {
-        Log.errorln(F("Unable to open preferences"));
-    }    
-
-    // Loop through all the key-value pairs in obj
-    for (JsonPair p : conf)
-    {
-
-        const char *key = p.key().c_str();
-        Log.traceln(F("Processing: { \"%s\": %s }"), key, p.value().as<String>().c_str());
-
-        // Check for indexed keys
-
-        char cKey[20];
-        strncpy(cKey, key, sizeof(cKey) - 1);
-        String sKey = String(cKey);
-        int len = strlen(key);
-        byte index = 0;
-        if (len > 3 && key[len - 3] == '[' && isDigit(key[len - 2]) && key[len - 1] == ']')
-        {
-            index = (byte)key[len - 2] - '0';
-            cKey[len - 3] = 0;
-
-            if (index >= PROBE_COUNT)
-            {
-                Log.error(F("Configuration impossible as index (%d) is higher than the number of probes supported when compiling (%d)."), index, PROBE_COUNT);
-                continue;
-            }
-
-            Log.traceln(F("Indexed key found: %s[%d]"), cKey, index);
-        }
-
-        // Process setting
-        /*******************/
-        //    min level
-        /*******************/
-        if (strcmp(cKey, "minLevel") == 0)
-        {
-            if (isnan(minLevel[index]) || minLevel[index] != (int)p.value())
-            {
-                minLevel[index] = (int)p.value();
-                if (minLevel[index] > FARTHEST)
-                {
-                    minLevel[index] = FARTHEST;
-                    Log.warningln(F("Min level in beyond max range. Setting probe %d to %d mm"), index, FARTHEST);
-                }
-                preferences.putInt(String("minLevel-" + index).c_str(), minLevel[index]);
-
-                Log.noticeln(F("New minimum level set for probe %d: %d"), index, minLevel[index]);
-            }
-            else
-            {
-                Log.verboseln(F("Value unchanged. Ignoring"));
-            }
-        }
-        /*******************/
-        //    max level
-        /*******************/
-        else if (strcmp(cKey, "maxLevel") == 0)
-        {
-            if (isnan(maxLevel[index]) || maxLevel[index] != (int)p.value())
-            {
-                maxLevel[index] = (int)p.value();
-                if (maxLevel[index] < CLOSEST)
-                {
-                    maxLevel[index] = CLOSEST;
-                    Log.warningln(F("Max level in blind zone. Setting probe %d to %d mm"), index, CLOSEST);
-                }
-                preferences.putInt(String("maxLevel-" + index).c_str(), maxLevel[index]);
-
-                Log.noticeln(F("New maximum level set for probe %d: %d"), index, maxLevel[index]);
-            }
-            else
-            {
-                Log.verboseln(F("Value unchanged. Ignoring"));
-            }
-        }
-        /*******************/
-        //   sleep Time
-        /*******************/
-        else if (strcmp(key, "sleepTime") == 0)
-        {
-            if (isnan(sleepTime) || sleepTime / 1e6 != p.value())
-            {
-                sleepTime = p.value();
-
-                if (sleepTime > 1e12)
-                {
-                    sleepTime = 1e18;
-                }
-                else
-                {
-                    sleepTime *= 1e6;
-                }
-
-                preferences.putULong64("sleepTime", sleepTime);
-
-                Log.noticeln(F("New sleep time set: %i s"), (int)(sleepTime / 1e6));
-            }
-            else
-            {
-                Log.verboseln(F("Value unchanged. Ignoring"));
-            }
-        }
-        /***************************/
-        //   sleep Time On Power
-        /***************************/
-        else if (strcmp(key, "sleepTimeOnPower") == 0)
-        {
-            if (isnan(sleepTimeOnPower) || sleepTimeOnPower / 1e6 != p.value())
-            {
-                sleepTimeOnPower = p.value();
-
-                if (sleepTimeOnPower > 1e12)
-                {
-                    sleepTimeOnPower = 1e18;
-                }
-                else
-                {
-                    sleepTimeOnPower *= 1e6;
-                }
-
-                preferences.putULong64("sleepTimeOnPow", sleepTimeOnPower);
-
-                Log.noticeln(F("New sleep time on power set: %i s"), (int)(sleepTimeOnPower / 1e6));
-            }
-            else
-            {
-                Log.verboseln(F("Value unchanged. Ignoring"));
-            }
-        }
-        /***************************/
-        //   On Power Threshold
-        /***************************/
-        else if (strcmp(key, "onPowerThreshold") == 0)
-        {
-            if (isnan(onPowerThreshold) || onPowerThreshold != p.value())
-            {
-                onPowerThreshold = p.value();
-
-                if (onPowerThreshold > 10)
-                {
-                    onPowerThreshold = 10;
-                }
-
-                if (onPowerThreshold < 2)
-                {
-                    onPowerThreshold = 2;
-                }
-
-                preferences.putFloat("onPowerThresh", onPowerThreshold);
-
-                Log.noticeln(F("New power threshold set: %i s"), (int)(onPowerThreshold / 1e6));
-            }
-            else
-            {
-                Log.verboseln(F("Value unchanged. Ignoring"));
-            }
-        }
-        /*******************/
-        // max Difference
-        /*******************/
-        else if (strcmp(key, "maxDifference") == 0)
-        {
-            if (maxDifference != p.value())
-            {
-                if (p.value() <= 0 || p.value() > maxLevel[0])
-                {
-                    Log.warningln("Incorrect max difference value. Must be between 0 and maxLevel[0] (%D)", maxLevel[0]);
-                    continue;
-                }
-
-                maxDifference = p.value();
-
-                preferences.putUShort("maxDifference", maxDifference);
-
-                Log.noticeln(F("New max difference set: %d"), maxDifference);
-            }
-            else
-            {
-                Log.verboseln(F("Value unchanged. Ignoring"));
-            }
-        }
-        /*******************/
-        //     Log level
-        /*******************/
-        else if (strcmp(key, "logLevel") == 0)
-        {
-            if (logLevel != p.value())
-            {
-                logLevel = p.value();
-
-                if (logLevel > LOG_LEVEL_VERBOSE)
-                {
-                    logLevel = LOG_LEVEL_VERBOSE;
-                }
-                Log.setLevel(logLevel);
-                esp_log_level_set("*", (esp_log_level_t) (logLevel == 0 ? 0 : logLevel - 1));
-                preferences.putUShort("logLevel", logLevel);
-                Log.noticeln(F("New log level set: %d"), logLevel);
-            }
-            else
-            {
-                Log.verboseln(F("Value unchanged. Ignoring"));
-            }
-        }
-        else
-        {
-            Log.warningln(F("Unknown config parameter: %s"), p.key().c_str());
-        }
-    }
-
-    for (int i = 0; i < PROBE_COUNT; i++) {
-        if (minLevel[i] < maxLevel[i])
-        {
-            Log.warningln("Minimum level %d should be bigger than maximum level because the water is further away from the sensor when the level is at its minimum.", i);
-        }
-    }
-
-    preferences.end();
     removeConfigMsg = true;
 }
 
-void updateMsg(String topic, String payload)
+// Download and flash a new firmware. The device has to be restarted to run it.
+bool firmwareUpdate(const char *url)
+{
+    Log.noticeln(F("Received an OTA message. Preparing to download from %s."), url);
+    return update(url, 80);
+}
+
+// The URL is the payload, ended by the callback
+void updateMsg(const char *url, unsigned int length)
 {
 
-    if (payload.length() == 0)
+    if (length == 0)
     {
         return;
     }
 
-    Log.noticeln(F("Received an OTA message. Preparing to download from %s."), payload.c_str());
-
-    if (update(payload, 80))
+    if (firmwareUpdate(url))
     {
         Log.noticeln(F("Ready to restart"));
-        client.publish((ROOT_TOPIC + "/update/url").c_str(), new byte[0], 0, true);
+        client.publish(getTopic(TOPIC_UPDATE_URL), NULL, 0, true);
         client.flush();
         client.loop();
         delay(1000);
@@ -275,182 +64,238 @@ void updateMsg(String topic, String payload)
     }
 }
 
-void fileGet(String fileName)
+// Queue the transfer of a file: "name", "name,offset" or "name,offset,length".
+// The chunks are sent by fileTransferContinue().
+bool fileGet(const char *request, size_t length)
 {
+    // The request has been received, whatever happens next
+    client.publish(getTopic(TOPIC_FILE_GET), NULL, 0, true);
 
-    if (fileName.length() == 0)
+    FileRequest parsed;
+    if (!parseFileRequest(request, length, parsed))
     {
-        Log.errorln(F("File name is empty"));
-        return;
+        return false;
     }
 
     if (!LittleFS.begin(false, BASE_PATH, MAX_OPEN_FILE, PARTITION_LABEL)) {
         Log.errorln(F("Failed to mount LittleFS"));
-        return;
+        return false;
     }
 
-    if (!LittleFS.exists(fileName))
+    if (!LittleFS.exists(parsed.name))
     {
         Log.errorln(F("File does not exist"));
-        return;
+        return false;
     }
 
-    File file = LittleFS.open(fileName, "r");
+    File file = LittleFS.open(parsed.name, "r");
     if (!file || file.isDirectory())
     {
         Log.errorln(F("Failed to open file"));
-        return;
+        return false;
     }
 
-    String dataTopic = ROOT_TOPIC + "/file/data" + fileName;
-    Log.noticeln(F("Sending file %s (size = %d) on topic '%s'"), fileName.c_str(), file.size(), dataTopic.c_str());
-    String content = file.readString();
-    
-    if (content.length() == 0)
+    uint32_t size = file.size();
+    file.close();
+
+    if (parsed.offset > size)
     {
-        Log.warningln(F("Failed to read file"));
-        byte *contentByte = new byte[file.size()];
-        file.readBytes((char *)contentByte, file.size());
-        content = base64::encode(contentByte, file.size());
+        Log.errorln(F("Offset %l beyond the end of %s (%l bytes)"), parsed.offset, parsed.name, size);
+        return false;
     }
-    file.close();
-    
-    String contentPart = String(MQTT_MAX_PACKET_SIZE / 2);
-    for (int i = 0; i < content.length(); i += contentPart.length() + 1)
+
+    if (fileTransfer.name[0] != 0)
     {
-        contentPart = content.substring(i, i + MQTT_MAX_PACKET_SIZE / 2);
-        contentPart = contentPart.substring(0, contentPart.lastIndexOf('\n'));
-        client.publish(dataTopic.c_str(), contentPart.c_str(), false);
-        client.flush();
+        Log.warningln(F("Transfer of %s cancelled at %l"), fileTransfer.name, fileTransfer.offset);
     }
-    
-    client.publish((ROOT_TOPIC + "/file/get").c_str(), new byte[0], 0, true);
+
+    strcpy(fileTransfer.name, parsed.name);
+    fileTransfer.offset = parsed.offset;
+    fileTransfer.end = parsed.length < size - parsed.offset ? parsed.offset + parsed.length : size;
+    Log.noticeln(F("Sending file %s (bytes %l to %l of %l) on topic '%s'"), fileTransfer.name, fileTransfer.offset,
+                 fileTransfer.end, size, topicWith(TOPIC_FILE_DATA, fileTransfer.name));
+    return true;
 }
 
-void dirList(String dirName)
+bool fileTransferPending()
 {
-    Log.noticeln(F("Listing directory %s"), dirName.c_str());
-    if (dirName.length() == 0)
+    return fileTransfer.name[0] != 0;
+}
+
+// Send the chunks of the current transfer until it is done or the deadline (millis)
+// passes. An interrupted transfer goes on at the next connection.
+bool fileTransferContinue(unsigned long deadline)
+{
+    if (!fileTransferPending())
     {
-        Log.errorln(F("Directory name is empty"));
-        return;
+        return true;
     }
 
     if (!LittleFS.begin(false, BASE_PATH, MAX_OPEN_FILE, PARTITION_LABEL)) {
         Log.errorln(F("Failed to mount LittleFS"));
-        return;
+        return false;
     }
 
-    if (!LittleFS.exists(dirName))
+    File file = LittleFS.open(fileTransfer.name, "r");
+    if (!file || !file.seek(fileTransfer.offset))
     {
-        Log.errorln(F("Directory %s does not exist"), dirName.c_str());
-        return;
+        Log.errorln(F("Failed to open file %s"), fileTransfer.name);
+        fileTransfer.name[0] = 0;
+        return false;
     }
 
-    File file = LittleFS.open(dirName, "r");
-    if (!file || !file.isDirectory())
+    uint32_t size = file.size();
+    const char *dataTopic = topicWith(TOPIC_FILE_DATA, fileTransfer.name);
+
+    while (fileTransfer.offset < fileTransfer.end && (long)(millis() - deadline) < 0)
     {
-        Log.errorln(F("Failed to open directory %s"), dirName.c_str());
-        return;
-    }
+        size_t length = min((uint32_t)FILE_CHUNK_SIZE, fileTransfer.end - fileTransfer.offset);
+        if (file.read(fileChunk.data, length) != length)
+        {
+            Log.errorln(F("Failed to read %s at %l"), fileTransfer.name, fileTransfer.offset);
+            break;
+        }
+
+        fileChunk.header.offset = fileTransfer.offset;
+        fileChunk.header.total = size;
+        fileChunk.header.crc = esp_rom_crc32_le(0, fileChunk.data, length);
+
+        size_t messageLength = sizeof(fileChunk.header) + length;
+        if (!client.beginPublish(dataTopic, messageLength, false) ||
+            client.write((const uint8_t *)&fileChunk, messageLength) != messageLength ||
+            !client.endPublish())
+        {
+            Log.errorln(F("Failed to send %s at %l"), fileTransfer.name, fileTransfer.offset);
+            break;
+        }
 
-    String dataTopic = ROOT_TOPIC + "/file/dir" + dirName;
-    file.rewindDirectory();
+        fileTransfer.offset += length;
+    }
+    file.close();
 
-    String nextFileName = file.getNextFileName();
-    while (nextFileName != "") {
-        File f = LittleFS.open(dirName + "/" + nextFileName, "r");
-        String data = nextFileName + "," + String(f.size());
-        f.close();
-        client.publish(dataTopic.c_str(), data.c_str(), false);
-        nextFileName = file.getNextFileName();
+    if (fileTransfer.offset < fileTransfer.end)
+    {
+        Log.noticeln(F("Transfer of %s paused at %l"), fileTransfer.name, fileTransfer.offset);
+        return false;
     }
 
-    client.flush();
-    
-    client.publish((ROOT_TOPIC + "/file/dirlist").c_str(), new byte[0], 0, true);
+    Log.noticeln(F("File %s sent"), fileTransfer.name);
+    fileTransfer.name[0] = 0;
+    return true;
 }
 
-void callback(char *topic, byte *payload, unsigned int length)
+// Listing being sent, too big for the stack
+static DirPage dirPage;
+
+int dirList(const char *request, size_t length)
 {
-    if (length == 0)
+    char dirName[FILE_NAME_MAX_LENGTH];
+    if (!copyFileName(dirName, request, length))
     {
-        return;
+        return -1;
     }
+    Log.noticeln(F("Listing directory %s"), dirName);
 
-    callback_running = true;
-    // Stop sending log to MQTT to avoid deadlocks
-    // mqttLog.setSuspend(true);
-    payload[length] = '\0';
-
-    String _topic = String(topic);
-    String _payload = String((char *)payload);
-    Log.noticeln(F("Message received on topic: %s"), _topic.c_str());
+    if (!LittleFS.begin(false, BASE_PATH, MAX_OPEN_FILE, PARTITION_LABEL)) {
+        Log.errorln(F("Failed to mount LittleFS"));
+        return -1;
+    }
 
-    if (_topic.equals(ROOT_TOPIC + "/update/url") == 1)
+    dirPageBegin(dirPage, dirName);
+    int count = listDir(dirName, dirPageAdd, &dirPage);
+    if (count < 0)
     {
-        updateMsg(_topic, _payload);
+        Log.errorln(F("Failed to open directory %s"), dirName);
+        return -1;
     }
 
-    if (_topic.equals(ROOT_TOPIC + "/config") == 1)
+    dirPageSend(dirPage, true);
+    Log.noticeln(F("%d entries listed in %d pages"), count, dirPage.number);
+
+    client.publish(getTopic(TOPIC_FILE_DIRLIST), NULL, 0, true);
+    return count;
+}
+
+void callback(char *topic, byte *payload, unsigned int length)
+{
+    if (length == 0)
     {
-        configMsg(_topic, _payload);
+        return;
     }
 
-    if (_topic.equals(ROOT_TOPIC + "/file/get") == 1)
+    int8_t id = topicId(topic);
+
+    // Our own marker, not worth a log line
+    if (id == TOPIC_SYNC)
     {
-        fileGet(_payload);
+        syncReceived = length == strlen(syncMarker) && memcmp(payload, syncMarker, length) == 0;
+        return;
     }
 
-    if (_topic.equals(ROOT_TOPIC + "/file/dirlist") == 1)
+    callback_running = true;
+    // Stop sending log to MQTT to avoid deadlocks
+    // mqttLog.setSuspend(true);
+    payload[length] = '\0';
+
+    Log.noticeln(F("Message received on topic: %s"), topic);
+
+    switch (id)
     {
-        dirList(_payload);
+    case TOPIC_UPDATE_URL:
+        updateMsg((char *)payload, length);
+        break;
+    case TOPIC_CONFIG:
+        configMsg((char *)payload, length);
+        break;
+    case TOPIC_FILE_GET:
+        fileGet((char *)payload, length);
+        break;
+    case TOPIC_FILE_DIRLIST:
+        dirList((char *)payload, length);
+        break;
+    case TOPIC_RPC_REQUEST:
+        rpcQueue(payload, length);
+        break;
+    default:
+        Log.warningln(F("Unexpected topic %s"), topic);
+        break;
     }
 
     callback_running = false;
 }
 
-bool reconnect()
+// Publish a marker on a subscribed topic and process the incoming messages
+// until it comes back, the deadline (millis) passes or the connection is lost
+bool mqttSync(unsigned long deadline)
 {
-    // Init MQTT
-    client.setServer(MQTT_SERVER, 1883);
-    int i = 3;
+    static uint8_t sequence = 0;
 
-    // Loop until we're reconnected
-    while (!client.connected() && i > 0)
-    {
-        Log.noticeln(F("Connecting to MQTT"));
+    snprintf(syncMarker, sizeof(syncMarker), "%lu-%u", (unsigned long)run, ++sequence);
+    syncReceived = false;
 
-        // Create a random client ID
-        String clientId = "waterLevel-";
-        clientId += String(random(0xffff), HEX);
+    if (!client.publish(getTopic(TOPIC_SYNC), syncMarker, false))
+    {
+        Log.errorln(F("Failed to send the sync marker"));
+        return false;
+    }
 
-        // Attempt to connect
-        if (client.connect(clientId.c_str()))
+    while (!syncReceived || callback_running)
+    {
+        if (!client.connected())
         {
-            // ... and resubscribe
-            client.setCallback(callback);
-            client.subscribe((ROOT_TOPIC + "/config").c_str());
-            client.subscribe((ROOT_TOPIC + "/update/url").c_str());
-            client.subscribe((ROOT_TOPIC + "/file/get").c_str());
-            client.subscribe((ROOT_TOPIC + "/file/dirlist").c_str());
-            Log.noticeln(F("Subscription done"));
-            delay(100);
-            return true;
+            Log.warningln(F("Connection lost while waiting for the sync marker"));
+            return false;
         }
-        else
+
+        if ((long)(millis() - deadline) >= 0)
         {
-            Log.errorln(F("Failed, rc=%d try again in 1 seconds"), client.state());
-            // Wait 1 seconds before retrying
-            delay(1000);
+            Log.warningln(F("No sync marker before the deadline"));
+            return false;
         }
-        i--;
-    }
 
-    if (i <= 0)
-    {
-        Log.warningln(F("Failed to send MQTT message"));
-        return false;
+        mqttLog.setSuspend(false);
+        client.loop();
+        delay(1);
     }
 
     return true;
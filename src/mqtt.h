@@ -1,11 +1,34 @@
 #include <ArduinoJson.h>
-#include <ArduinoLog.h>
+#include "LogFloor.h"
 #include <PubSubClient.h>
-#include "ota.h"
 #include "global_vars.h"
 #include "Arduino.h"
-#include <LittleFS.h>
-#include <Preferences.h>
+#include "settings.h"
+#include "configure.h"
+#include "telemetry.h"
+#include "topics.h"
+#include "files.h"
+#include "ArenaAllocator.h"
+#include "rpc.h"
+#include "connection.h"
 
-bool reconnect();
-void fileGet(String fileName);
\ No newline at end of file
+bool mqttSync(unsigned long deadline);
+// Transfer of a file in chunks, resumed on the next wake if needed
+struct FileTransfer {
+    char     name[FILE_NAME_MAX_LENGTH];  // empty when no transfer is in progress
+    uint32_t offset;                      // next byte to send
+    uint32_t end;                         // first byte not to send
+};
+
+// Header of each chunk on ROOT_TOPIC/file/data<name>, little endian
+struct __attribute__((packed)) FileChunkHeader {
+    uint32_t offset;                      // position of the chunk in the file
+    uint32_t total;                       // file size
+    uint32_t crc;                         // CRC32 of the chunk data
+};
+
+bool firmwareUpdate(const char *url);
+bool fileGet(const char *request, size_t length);
+int  dirList(const char *request, size_t length);
+bool fileTransferPending();
+bool fileTransferContinue(unsigned long deadline);
\ No newline at end of file
@@ -1,7 +1,7 @@
 #include "Arduino.h"
 #include <WiFi.h>
 #include <Update.h>
-#include <ArduinoLog.h>
+#include "LogFloor.h"
 
 #include <WiFiUdp.h>
 #include "TFTPClient.h"
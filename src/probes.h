@@ -0,0 +1,150 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+#include "Arduino.h"
+#include <type_traits>
+
+// Time to wait before firing a probe, depending on the previous probe fired
+#define PROBE_SETTLE_SAME_TANK_MS 60  // ms, let the echoes die down in the tank
+#define PROBE_SETTLE_OTHER_TANK_MS 5  // ms
+
+/*********\
+ * Probe *
+\*********/
+
+// Wiring of one probe. Probes in the same tank hear each other's echoes.
+template <uint8_t Trig, uint8_t Echo, uint8_t Tank>
+struct Probe
+{
+    static constexpr uint8_t trigPin = Trig;
+    static constexpr uint8_t echoPin = Echo;
+    static constexpr uint8_t tank = Tank;
+};
+
+/***************\
+ * Probe array *
+\***************/
+
+// Compile time list of probes
+template <typename... Probes>
+struct ProbeList;
+
+template <>
+struct ProbeList<>
+{
+    static constexpr uint8_t count = 0;
+
+    static constexpr uint8_t trigAt(uint8_t) { return 0xFF; }
+    static constexpr uint8_t echoAt(uint8_t) { return 0xFF; }
+    static constexpr uint8_t tankAt(uint8_t) { return 0xFF; }
+};
+
+template <typename P, typename... Rest>
+struct ProbeList<P, Rest...>
+{
+    static constexpr uint8_t count = 1 + sizeof...(Rest);
+
+    static constexpr uint8_t trigAt(uint8_t i) { return i == 0 ? P::trigPin : ProbeList<Rest...>::trigAt(i - 1); }
+    static constexpr uint8_t echoAt(uint8_t i) { return i == 0 ? P::echoPin : ProbeList<Rest...>::echoAt(i - 1); }
+    static constexpr uint8_t tankAt(uint8_t i) { return i == 0 ? P::tank : ProbeList<Rest...>::tankAt(i - 1); }
+};
+
+// Probes are fired round robin across the tanks: the first probe of each tank, then
+// the second one, ... so that two probes of the same tank are only fired one after
+// the other when it cannot be avoided.
+template <typename... Probes>
+struct ProbeArray : ProbeList<Probes...>
+{
+    typedef ProbeList<Probes...> List;
+    using List::count;
+    using List::trigAt;
+    using List::echoAt;
+    using List::tankAt;
+
+    // Number of probes before probe i in the same tank
+    static constexpr uint8_t rank(uint8_t i, uint8_t j = 0)
+    {
+        return j >= i ? 0 : (tankAt(j) == tankAt(i)) + rank(i, j + 1);
+    }
+
+    static constexpr bool firedBefore(uint8_t a, uint8_t b)
+    {
+        return rank(a) < rank(b) || (rank(a) == rank(b) && a < b);
+    }
+
+    // Slot in which probe i is fired
+    static constexpr uint8_t slotOf(uint8_t i, uint8_t j = 0)
+    {
+        return j >= count ? 0 : firedBefore(j, i) + slotOf(i, j + 1);
+    }
+
+    // Probe fired in a slot
+    static constexpr uint8_t probeAt(uint8_t slot, uint8_t i = 0)
+    {
+        return i >= count ? 0xFF : slotOf(i) == slot ? i : probeAt(slot, i + 1);
+    }
+
+    // Delay before firing a slot
+    static constexpr uint16_t settleBefore(uint8_t slot)
+    {
+        return slot == 0 ? 0
+               : tankAt(probeAt(slot)) == tankAt(probeAt(slot - 1)) ? PROBE_SETTLE_SAME_TANK_MS
+                                                                    : PROBE_SETTLE_OTHER_TANK_MS;
+    }
+
+    // Total settle time of a measuring cycle
+    static constexpr uint16_t settleTime(uint8_t slot = 0)
+    {
+        return slot >= count ? 0 : settleBefore(slot) + settleTime(slot + 1);
+    }
+
+    static void init()
+    {
+        initFrom<0>(std::integral_constant<bool, (count > 0)>());
+    }
+
+    // Calls measure(index, trigPin, echoPin) for each probe, in firing order
+    template <typename F>
+    static void measure(F measure)
+    {
+        measureFrom<0>(measure, std::integral_constant<bool, (count > 0)>());
+    }
+
+private:
+    template <uint8_t I>
+    static void initFrom(std::true_type)
+    {
+        pinMode(trigAt(I), OUTPUT);
+        pinMode(echoAt(I), INPUT);
+        digitalWrite(trigAt(I), LOW);
+        initFrom<I + 1>(std::integral_constant<bool, (I + 1 < count)>());
+    }
+
+    template <uint8_t I>
+    static void initFrom(std::false_type) {}
+
+    template <uint8_t Slot, typename F>
+    static void measureFrom(F &measure, std::true_type)
+    {
+        constexpr uint8_t p = probeAt(Slot);
+        if (settleBefore(Slot) > 0)
+        {
+            delay(settleBefore(Slot));
+        }
+        measure(p, trigAt(p), echoAt(p));
+        measureFrom<Slot + 1>(measure, std::integral_constant<bool, (Slot + 1 < count)>());
+    }
+
+    template <uint8_t Slot, typename F>
+    static void measureFrom(F &, std::false_type) {}
+};
+
+// Schedule checks
+static_assert(ProbeArray<Probe<0, 1, 0>>::probeAt(0) == 0, "Single probe schedule");
+static_assert(ProbeArray<Probe<0, 1, 0>, Probe<2, 3, 0>>::settleTime() == PROBE_SETTLE_SAME_TANK_MS,
+              "Two probes in the same tank schedule");
+static_assert(ProbeArray<Probe<0, 1, 0>, Probe<2, 3, 0>, Probe<4, 5, 1>, Probe<6, 7, 1>>::probeAt(1) == 2 &&
+              ProbeArray<Probe<0, 1, 0>, Probe<2, 3, 0>, Probe<4, 5, 1>, Probe<6, 7, 1>>::settleTime() == 3 * PROBE_SETTLE_OTHER_TANK_MS,
+              "Four probes in two tanks schedule");
+
+#endif
@@ -0,0 +1,141 @@
+#include "profiler.h"
+#include "topics.h"
+#include <esp_timer.h>
+
+/************\
+ * Profiler *
+\************/
+
+RTC_DATA_ATTR PhaseStats phaseStats[PHASE_COUNT];
+RTC_DATA_ATTR uint16_t   profileCycles = 0;
+RTC_DATA_ATTR uint16_t   drainTimeouts = 0;    // drains ended by the deadline
+
+// Start time of the phases in progress
+static int64_t phaseStart[PHASE_COUNT];
+
+// Upper bound of each histogram bucket
+static const uint32_t BUCKET_LIMITS[PROFILE_BUCKETS - 1] = {100, 1000, 10000, 100000, 1000000};
+
+static char profileMsg[PHASE_COUNT * 112 + 48];
+
+static const char *phaseName(uint8_t phase, char *buffer, size_t size)
+{
+    switch (phase)
+    {
+    case PHASE_BOOT:     return "boot";
+    case PHASE_NVS:      return "nvs";
+    case PHASE_FS_MOUNT: return "fs";
+    case PHASE_BATTERY:  return "battery";
+    case PHASE_WIFI:     return "wifi";
+    case PHASE_MQTT:     return "mqtt";
+    case PHASE_PUBLISH:  return "publish";
+    case PHASE_DRAIN:    return "drain";
+    case PHASE_SLEEP:    return "sleep";
+    }
+
+    snprintf(buffer, size, "probe%d", phase - PHASE_PROBE);
+    return buffer;
+}
+
+void profileStart(uint8_t phase)
+{
+    phaseStart[phase] = esp_timer_get_time();
+}
+
+void profileEnd(uint8_t phase)
+{
+    if (phaseStart[phase] == 0)
+    {
+        return;
+    }
+
+    profileRecord(phase, (uint32_t)(esp_timer_get_time() - phaseStart[phase]));
+    phaseStart[phase] = 0;
+}
+
+void profileRecord(uint8_t phase, uint32_t duration)
+{
+    PhaseStats &stats = phaseStats[phase];
+
+    if (stats.count == 0 || duration < stats.min)
+    {
+        stats.min = duration;
+    }
+    if (duration > stats.max)
+    {
+        stats.max = duration;
+    }
+    stats.count++;
+    stats.sum += duration;
+
+    uint8_t bucket = 0;
+    while (bucket < PROFILE_BUCKETS - 1 && duration >= BUCKET_LIMITS[bucket])
+    {
+        bucket++;
+    }
+    if (stats.histogram[bucket] < UINT16_MAX)
+    {
+        stats.histogram[bucket]++;
+    }
+}
+
+void profileCycleEnd()
+{
+    if (profileCycles < UINT16_MAX)
+    {
+        profileCycles++;
+    }
+}
+
+void profileDrainTimeout()
+{
+    if (drainTimeouts < UINT16_MAX)
+    {
+        drainTimeouts++;
+    }
+}
+
+bool profilePublish()
+{
+    if (profileInterval == 0 || profileCycles < profileInterval)
+    {
+        return true;
+    }
+
+    // {"cycles":N,"drainTimeouts":N,"boot":[count,min,avg,max,[histogram]],...} with durations in us
+    size_t len = snprintf(profileMsg, sizeof(profileMsg), "{\"cycles\":%u,\"drainTimeouts\":%u", profileCycles, drainTimeouts);
+    char name[12];
+
+    for (uint8_t phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        const PhaseStats &stats = phaseStats[phase];
+        if (stats.count == 0)
+        {
+            continue;
+        }
+
+        len += snprintf(&profileMsg[len], sizeof(profileMsg) - len, ",\"%s\":[%lu,%lu,%lu,%lu,[",
+                        phaseName(phase, name, sizeof(name)), (unsigned long)stats.count, (unsigned long)stats.min,
+                        (unsigned long)(stats.sum / stats.count), (unsigned long)stats.max);
+        for (uint8_t bucket = 0; bucket < PROFILE_BUCKETS; bucket++)
+        {
+            len += snprintf(&profileMsg[len], sizeof(profileMsg) - len, bucket == 0 ? "%u" : ",%u", stats.histogram[bucket]);
+        }
+        len += snprintf(&profileMsg[len], sizeof(profileMsg) - len, "]]");
+    }
+    len += snprintf(&profileMsg[len], sizeof(profileMsg) - len, "}");
+
+    if (!client.beginPublish(getTopic(TOPIC_STATS_PROFILE), len, false) ||
+        client.write((const uint8_t *)profileMsg, len) != len ||
+        !client.endPublish())
+    {
+        Log.errorln(F("Failed to send profile"));
+        return false;
+    }
+
+    Log.noticeln(F("Profile of %d cycles sent"), profileCycles);
+    memset(phaseStats, 0, sizeof(phaseStats));
+    profileCycles = 0;
+    drainTimeouts = 0;
+    return true;
+}
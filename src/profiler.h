@@ -0,0 +1,41 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "Arduino.h"
+#include "global_vars.h"
+#include "LogFloor.h"
+
+#define PROFILE_BUCKETS 6               // <100us, <1ms, <10ms, <100ms, <1s, more
+
+// Phases of a wake cycle
+enum Phase {
+    PHASE_BOOT = 0,                     // reset to setup()
+    PHASE_NVS,                          // settings load (cold boot only)
+    PHASE_FS_MOUNT,                     // LittleFS mount and log file opening
+    PHASE_BATTERY,
+    PHASE_PROBE,                        // + probe index
+    PHASE_WIFI = PHASE_PROBE + PROBE_COUNT,
+    PHASE_MQTT,
+    PHASE_PUBLISH,
+    PHASE_DRAIN,                        // incoming messages and callbacks
+    PHASE_SLEEP,                        // sleep preparation
+    PHASE_COUNT
+};
+
+// Timing statistics of one phase, kept in RTC memory across cycles
+struct PhaseStats {
+    uint32_t count;
+    uint32_t min;                       // us
+    uint32_t max;                       // us
+    uint64_t sum;                       // us
+    uint16_t histogram[PROFILE_BUCKETS];
+};
+
+void profileStart(uint8_t phase);
+void profileEnd(uint8_t phase);
+void profileRecord(uint8_t phase, uint32_t duration);
+void profileCycleEnd();
+void profileDrainTimeout();
+bool profilePublish();
+
+#endif
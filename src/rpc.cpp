@@ -0,0 +1,281 @@
+#include "rpc.h"
+#include "mqtt.h"
+#include "measure.h"
+#include "batch.h"
+#include "topics.h"
+#include "MultiPrint.h"
+#include "FilePrint.h"
+#include <esp_timer.h>
+
+/*******\
+ * RPC *
+\*******/
+
+// Requests are answered after the drain, all in a row. The queue survives
+// deep sleep so that a request acknowledged by the device is never lost.
+RTC_DATA_ATTR RpcRequest rpcRequests[RPC_QUEUE_SIZE];
+RTC_DATA_ATTR uint8_t    rpcCount = 0;
+
+static ArenaAllocator<RPC_ARENA_SIZE> rpcAllocator;
+static bool restartRequested = false;
+
+static int rpcConfig(JsonVariantConst params, JsonObject result)
+{
+    if (!params.is<JsonObjectConst>())
+    {
+        return RPC_BAD_REQUEST;
+    }
+
+    result["changed"] = applyConfig(params.as<JsonObjectConst>());
+    return RPC_OK;
+}
+
+static int rpcUpdate(JsonVariantConst params, JsonObject result)
+{
+    if (!params.is<const char *>())
+    {
+        return RPC_BAD_REQUEST;
+    }
+
+    if (!firmwareUpdate(params.as<const char *>()))
+    {
+        return RPC_FAILED;
+    }
+
+    restartRequested = true;
+    result["restart"] = true;
+    return RPC_OK;
+}
+
+static int rpcFileGet(JsonVariantConst params, JsonObject result)
+{
+    if (!params.is<const char *>())
+    {
+        return RPC_BAD_REQUEST;
+    }
+
+    JsonString request = params.as<JsonString>();
+    if (!fileGet(request.c_str(), request.size()))
+    {
+        return RPC_FAILED;
+    }
+
+    result["queued"] = true;
+    return RPC_OK;
+}
+
+static int rpcDirList(JsonVariantConst params, JsonObject result)
+{
+    if (!params.is<const char *>())
+    {
+        return RPC_BAD_REQUEST;
+    }
+
+    JsonString dirName = params.as<JsonString>();
+    int count = dirList(dirName.c_str(), dirName.size());
+    if (count < 0)
+    {
+        return RPC_FAILED;
+    }
+
+    result["entries"] = count;
+    result["topic"] = topicWith(TOPIC_FILE_DIR, dirName.c_str());
+    return RPC_OK;
+}
+
+static int rpcMeasureNow(JsonVariantConst params, JsonObject result)
+{
+    Probes::measure([](uint8_t i, uint8_t trigPin, uint8_t echoPin) {
+        waterLevel[i] = getWaterLevel(trigPin, echoPin, i);
+    });
+
+    JsonArray levels = result["levels"].to<JsonArray>();
+    JsonArray confidence = result["confidence"].to<JsonArray>();
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
+    {
+        levels.add(waterLevel[i]);
+        confidence.add(waterConfidence[i]);
+    }
+    return RPC_OK;
+}
+
+static int rpcStats(JsonVariantConst params, JsonObject result)
+{
+    result["run"] = run;
+    result["uptime"] = millis();
+    result["voltage"] = batteryLevel;
+    result["rssi"] = WiFi.RSSI();
+    result["failedConnection"] = failedConnection;
+    result["buffered"] = batchCount();
+    result["freeHeap"] = ESP.getFreeHeap();
+    result["minFreeHeap"] = ESP.getMinFreeHeap();
+    result["resetReason"] = (int)esp_reset_reason();
+    result["configLoadSaved"] = configLoadSaved;
+    result["connectLatency"] = connectionLatency();
+    result["connectFailures"] = connectionFailures();
+    result["backoff"] = connectionBackoff();
+    result["logDropped"] = mqttLog.getDropped();
+    result["logQueueDropped"] = MultiPrint::instance->getDropped();
+    result["logFileBytes"] = fileLog.getBytesWritten();
+    result["logFileWrites"] = fileLog.getWrites();
+    return RPC_OK;
+}
+
+static int rpcReboot(JsonVariantConst params, JsonObject result)
+{
+    restartRequested = true;
+    return RPC_OK;
+}
+
+static const RpcMethod RPC_METHODS[] = {
+    {"config",     rpcConfig},
+    {"update",     rpcUpdate},
+    {"fileGet",    rpcFileGet},
+    {"dirList",    rpcDirList},
+    {"measureNow", rpcMeasureNow},
+    {"stats",      rpcStats},
+    {"reboot",     rpcReboot},
+};
+
+// A retained request would come back on every wake: it is removed once queued,
+// like the other commands. The empty message removing it is ignored.
+bool rpcQueue(const uint8_t *payload, unsigned int length)
+{
+    if (length == 0)
+    {
+        return false;
+    }
+
+    if (length > RPC_REQUEST_MAX_LENGTH)
+    {
+        Log.errorln(F("RPC request too long (%d bytes)"), length);
+        client.publish(getTopic(TOPIC_RPC_REQUEST), NULL, 0, true);
+        return false;
+    }
+
+    // Left on the broker if retained, to be queued on the next wake
+    if (rpcCount >= RPC_QUEUE_SIZE)
+    {
+        Log.errorln(F("RPC queue full, request dropped"));
+        return false;
+    }
+
+    RpcRequest &request = rpcRequests[rpcCount++];
+    memcpy(request.payload, payload, length);
+    request.length = length;
+    client.publish(getTopic(TOPIC_RPC_REQUEST), NULL, 0, true);
+    return true;
+}
+
+bool rpcPending()
+{
+    return rpcCount > 0;
+}
+
+bool rpcRestartRequested()
+{
+    return restartRequested;
+}
+
+// {"id":..,"status":N,"us":N,"result":{..}} on ROOT_TOPIC/rpc/response/<id>
+static bool rpcRespond(const RpcRequest &request)
+{
+    rpcAllocator.reset();
+    JsonDocument input(&rpcAllocator);
+    JsonDocument output(&rpcAllocator);
+    int64_t start = esp_timer_get_time();
+
+    DeserializationError error = deserializeJson(input, request.payload, request.length);
+    if (error)
+    {
+        Log.errorln(F("RPC request not parsed: %s"), error.c_str());
+        return false;
+    }
+
+    // The id is part of the response topic
+    char id[RPC_ID_MAX_LENGTH];
+    JsonVariantConst requestId = input["id"];
+    if (requestId.is<const char *>())
+    {
+        strlcpy(id, requestId.as<const char *>(), sizeof(id));
+    }
+    else if (requestId.is<long>())
+    {
+        snprintf(id, sizeof(id), "%ld", requestId.as<long>());
+    }
+    else
+    {
+        Log.errorln(F("RPC request without id"));
+        return false;
+    }
+
+    if (id[0] == 0 || strpbrk(id, "/+#") != NULL)
+    {
+        Log.errorln(F("Invalid RPC request id %s"), id);
+        return false;
+    }
+
+    output["id"] = requestId;
+    const char *method = input["method"] | "";
+    int status = RPC_NOT_FOUND;
+
+    for (uint8_t i = 0; i < sizeof(RPC_METHODS) / sizeof(RPC_METHODS[0]); i++)
+    {
+        if (strcmp(method, RPC_METHODS[i].name) == 0)
+        {
+            Log.noticeln(F("RPC %s: %s"), id, method);
+            status = RPC_METHODS[i].handler(input["params"], output["result"].to<JsonObject>());
+            break;
+        }
+    }
+
+    if (status == RPC_NOT_FOUND)
+    {
+        Log.warningln(F("Unknown RPC method %s"), method);
+    }
+
+    output["status"] = status;
+    output["us"] = (uint32_t)(esp_timer_get_time() - start);
+
+    if (output.overflowed())
+    {
+        Log.errorln(F("RPC response to %s too large"), id);
+        return false;
+    }
+
+    char topic[TOPIC_MAX_LENGTH + RPC_ID_MAX_LENGTH + 1];
+    snprintf(topic, sizeof(topic), "%s/%s", getTopic(TOPIC_RPC_RESPONSE), id);
+
+    size_t len = measureJson(output);
+    if (!client.beginPublish(topic, len, false) ||
+        serializeJson(output, client) != len ||
+        !client.endPublish())
+    {
+        Log.errorln(F("Failed to send the RPC response to %s"), id);
+        return false;
+    }
+
+    return true;
+}
+
+// Answer the queued requests. Returns true if something was sent.
+bool rpcProcess()
+{
+    if (rpcCount == 0)
+    {
+        return false;
+    }
+
+    uint8_t answered = 0;
+    for (uint8_t i = 0; i < rpcCount; i++)
+    {
+        if (rpcRespond(rpcRequests[i]))
+        {
+            answered++;
+        }
+    }
+    Log.noticeln(F("%d of %d RPC requests answered"), answered, rpcCount);
+
+    rpcCount = 0;
+    return true;
+}
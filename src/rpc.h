@@ -0,0 +1,34 @@
+#ifndef RPC_H
+#define RPC_H
+
+#include "Arduino.h"
+#include "global_vars.h"
+#include <ArduinoJson.h>
+#include "LogFloor.h"
+
+// Status of a response, as in HTTP
+#define RPC_OK          200
+#define RPC_BAD_REQUEST 400
+#define RPC_NOT_FOUND   404
+#define RPC_FAILED      500
+
+// Fills the result of a request and returns its status
+typedef int (*RpcHandler)(JsonVariantConst params, JsonObject result);
+
+struct RpcMethod {
+    const char *name;
+    RpcHandler  handler;
+};
+
+// Request received on ROOT_TOPIC/rpc/request, kept until it is answered
+struct RpcRequest {
+    uint16_t length;
+    char     payload[RPC_REQUEST_MAX_LENGTH];
+};
+
+bool rpcQueue(const uint8_t *payload, unsigned int length);
+bool rpcPending();
+bool rpcProcess();
+bool rpcRestartRequested();
+
+#endif
@@ -0,0 +1,482 @@
+#include "settings.h"
+#include "telemetry.h"
+#include "topics.h"
+#include <esp_rom_crc.h>
+#include <algorithm>
+
+/************\
+ * Settings *
+\************/
+
+// The settings live in RTC memory. Changes are only written to NVS once per
+// cycle, when going to sleep, to save flash wear and erase/write time.
+RTC_DATA_ATTR uint64_t settingsDirty = 0;
+RTC_DATA_ATTR bool     settingsUrgent = false;
+RTC_DATA_ATTR uint32_t lastCommitRun = 0;
+
+// The RTC copy of the settings is only trusted if it was sealed by the same firmware layout
+RTC_DATA_ATTR uint16_t settingsVersion = 0;
+RTC_DATA_ATTR uint32_t settingsCrc = 0;
+RTC_DATA_ATTR uint32_t nvsLoadTime = 0;  // us, measured on the last cold boot
+
+// Time saved by not reading the settings from NVS on this wake
+uint32_t configLoadSaved = 0;
+
+// The schema is published once per cold boot (power on, new firmware)
+RTC_DATA_ATTR bool schemaSent = false;
+
+// The lines no output writes are not even formatted: the level of the logger
+// is logLevel, lowered to the most verbose output
+void logLevelChanged()
+{
+    uint8_t level = std::min(logLevel, std::max({logLevelSerial, logLevelFile, logLevelMqtt}));
+    Log.setLevel(level);
+    esp_log_level_set("*", (esp_log_level_t) (level == 0 ? 0 : level - 1));
+}
+
+static void sessionChanged()
+{
+    // Subscribe again on the next connection
+    sessionSubscribed = false;
+}
+
+// Configurable settings. The NVS types are the ones written by previous versions.
+const SettingInfo SETTING_TABLE[] = {
+    // name                 NVS key           dirty bit                    variable     NVS          probe  clamp  variable            scale min                   max                   default
+    {"minLevel",          "minLevel",       SETTING_MIN_LEVEL,           TYPE_INT32,  TYPE_INT32,  true,  true,  minLevel,           1,    CLOSEST,              FARTHEST,             CLOSEST,                    NULL},
+    {"maxLevel",          "maxLevel",       SETTING_MAX_LEVEL,           TYPE_INT32,  TYPE_INT32,  true,  true,  maxLevel,           1,    CLOSEST,              FARTHEST,             FARTHEST,                   NULL},
+    {"sleepTime",         "sleepTime",      SETTING_SLEEP_TIME,          TYPE_UINT64, TYPE_UINT64, false, true,  &sleepTime,         1e6,  1,                    1e12,                 DEFAULT_SLEEP_TIME / 1e6,   NULL},
+    {"sleepTimeOnPower",  "sleepTimeOnPow", SETTING_SLEEP_TIME_ON_POWER, TYPE_UINT64, TYPE_UINT64, false, true,  &sleepTimeOnPower,  1e6,  1,                    1e12,                 DEFAULT_SLEEP_TIME / 1e6,   NULL},
+    {"onPowerThreshold",  "onPowerThresh",  SETTING_ON_POWER_THRESHOLD,  TYPE_FLOAT,  TYPE_FLOAT,  false, true,  &onPowerThreshold,  1,    2,                    10,                   BATTERY_ON_POWER_THRESHOLD, NULL},
+    {"maxDifference",     "maxDifference",  SETTING_MAX_DIFFERENCE,      TYPE_UINT8,  TYPE_UINT16, false, false, &maxDifference,     1,    1,                    255,                  DEFAULT_MAX_DIFFERENCE,     NULL},
+    {"logLevel",          "logLevel",       SETTING_LOG_LEVEL,           TYPE_UINT8,  TYPE_UINT16, false, true,  &logLevel,          1,    LOG_LEVEL_SILENT,     LOG_LEVEL_VERBOSE,    LOG_LEVEL_NOTICE,           logLevelChanged},
+    {"temperature",       "temperature",    SETTING_TEMPERATURE,         TYPE_INT8,   TYPE_INT8,   false, false, &temperature,       1,    SOUND_TABLE_MIN_TEMP, SOUND_TABLE_MAX_TEMP, DEFAULT_TEMPERATURE,        NULL},
+    {"burstSize",         "burstSize",      SETTING_BURST_SIZE,          TYPE_UINT8,  TYPE_UINT8,  false, false, &burstSize,         1,    1,                    MAX_BURST_SIZE,       DEFAULT_BURST_SIZE,         NULL},
+    {"burstThreshold",    "burstThresh",    SETTING_BURST_THRESHOLD,     TYPE_UINT8,  TYPE_UINT8,  false, false, &burstThreshold,    1,    1,                    255,                  DEFAULT_BURST_THRESHOLD,    NULL},
+    {"batchSize",         "batchSize",      SETTING_BATCH_SIZE,          TYPE_UINT8,  TYPE_UINT8,  false, false, &batchSize,         1,    1,                    255,                  DEFAULT_BATCH_SIZE,         NULL},
+    {"batchDepth",        "batchDepth",     SETTING_BATCH_DEPTH,         TYPE_UINT8,  TYPE_UINT8,  false, false, &batchDepth,        1,    PROBE_COUNT,          MAX_BATCH_DEPTH,      DEFAULT_BATCH_DEPTH,        NULL},
+    {"profileInterval",   "profileInterv",  SETTING_PROFILE_INTERVAL,    TYPE_UINT8,  TYPE_UINT8,  false, false, &profileInterval,   1,    0,                    255,                  DEFAULT_PROFILE_INTERVAL,   NULL},
+    {"reportDelta",       "reportDelta",    SETTING_REPORT_DELTA,        TYPE_UINT16, TYPE_UINT16, false, false, &reportDelta,       1,    0,                    FARTHEST,             DEFAULT_REPORT_DELTA,       NULL},
+    {"heartbeatInterval", "heartbeat",      SETTING_HEARTBEAT_INTERVAL,  TYPE_UINT16, TYPE_UINT16, false, false, &heartbeatInterval, 1,    1,                    65535,                DEFAULT_HEARTBEAT_INTERVAL, NULL},
+    {"telemetryFormat",   "telemetryFmt",   SETTING_TELEMETRY_FORMAT,    TYPE_UINT8,  TYPE_UINT8,  false, false, &telemetryFormat,   1,    TELEMETRY_TOPICS,     TELEMETRY_BINARY,     TELEMETRY_TOPICS,           NULL},
+    {"persistentSession", "persistSess",    SETTING_PERSISTENT_SESSION,  TYPE_UINT8,  TYPE_UINT8,  false, false, &persistentSession, 1,    0,                    1,                    0,                          sessionChanged},
+    {"drainTimeout",      "drainTimeout",   SETTING_DRAIN_TIMEOUT,       TYPE_UINT16, TYPE_UINT16, false, false, &drainTimeout,      1,    10,                   10000,                DEFAULT_DRAIN_TIMEOUT,      NULL},
+    {"logLevelSerial",    "logLevelSer",    SETTING_LOG_LEVEL_SERIAL,    TYPE_UINT8,  TYPE_UINT8,  false, true,  &logLevelSerial,    1,    LOG_LEVEL_SILENT,     LOG_LEVEL_VERBOSE,    LOG_LEVEL_VERBOSE,          logLevelChanged},
+    {"logLevelFile",      "logLevelFile",   SETTING_LOG_LEVEL_FILE,      TYPE_UINT8,  TYPE_UINT8,  false, true,  &logLevelFile,      1,    LOG_LEVEL_SILENT,     LOG_LEVEL_VERBOSE,    LOG_LEVEL_VERBOSE,          logLevelChanged},
+    {"logLevelMqtt",      "logLevelMqtt",   SETTING_LOG_LEVEL_MQTT,      TYPE_UINT8,  TYPE_UINT8,  false, true,  &logLevelMqtt,      1,    LOG_LEVEL_SILENT,     LOG_LEVEL_VERBOSE,    LOG_LEVEL_VERBOSE,          logLevelChanged},
+};
+
+const uint8_t SETTING_TABLE_SIZE = sizeof(SETTING_TABLE) / sizeof(SETTING_TABLE[0]);
+
+static const char *const TYPE_NAMES[] = {"int8", "uint8", "uint16", "int32", "uint64", "float"};
+
+static size_t typeSize(uint8_t type)
+{
+    switch (type)
+    {
+    case TYPE_INT8:
+    case TYPE_UINT8:  return 1;
+    case TYPE_UINT16: return 2;
+    case TYPE_INT32:  return 4;
+    case TYPE_UINT64: return 8;
+    case TYPE_FLOAT:  return sizeof(float);
+    }
+    return 0;
+}
+
+static uint8_t valueCount(const SettingInfo &info)
+{
+    return info.perProbe ? PROBE_COUNT : 1;
+}
+
+static void *valueAt(const SettingInfo &info, uint8_t index)
+{
+    return (uint8_t *)info.value + index * typeSize(info.type);
+}
+
+// RTC value, in the unit of the variable
+static double getRaw(const SettingInfo &info, uint8_t index)
+{
+    void *value = valueAt(info, index);
+    switch (info.type)
+    {
+    case TYPE_INT8:   return *(int8_t *)value;
+    case TYPE_UINT8:  return *(uint8_t *)value;
+    case TYPE_UINT16: return *(uint16_t *)value;
+    case TYPE_INT32:  return *(int32_t *)value;
+    case TYPE_UINT64: return *(uint64_t *)value;
+    case TYPE_FLOAT:  return *(float *)value;
+    }
+    return 0;
+}
+
+static void setRaw(const SettingInfo &info, uint8_t index, double raw)
+{
+    void *value = valueAt(info, index);
+    switch (info.type)
+    {
+    case TYPE_INT8:   *(int8_t *)value = (int8_t)raw; break;
+    case TYPE_UINT8:  *(uint8_t *)value = (uint8_t)raw; break;
+    case TYPE_UINT16: *(uint16_t *)value = (uint16_t)raw; break;
+    case TYPE_INT32:  *(int32_t *)value = (int32_t)raw; break;
+    case TYPE_UINT64: *(uint64_t *)value = (uint64_t)raw; break;
+    case TYPE_FLOAT:  *(float *)value = (float)raw; break;
+    }
+}
+
+static uint32_t settingsCrcOf()
+{
+    uint32_t crc = 0;
+    for (uint8_t i = 0; i < SETTING_TABLE_SIZE; i++)
+    {
+        const SettingInfo &info = SETTING_TABLE[i];
+        crc = esp_rom_crc32_le(crc, (const uint8_t *)info.value, typeSize(info.type) * valueCount(info));
+    }
+    return crc;
+}
+
+bool settingsValid()
+{
+    unsigned long start = micros();
+    bool valid = settingsVersion == SETTINGS_VERSION && settingsCrc == settingsCrcOf();
+
+    if (valid)
+    {
+        unsigned long elapsed = micros() - start;
+        configLoadSaved = nvsLoadTime > elapsed ? nvsLoadTime - elapsed : 0;
+    }
+
+    return valid;
+}
+
+void sealSettings()
+{
+    settingsVersion = SETTINGS_VERSION;
+    settingsCrc = settingsCrcOf();
+}
+
+// NVS key of a probe-indexed setting, e.g. "minLevel-1"
+static const char *probeKey(char *buffer, size_t size, const char *name, uint8_t index)
+{
+    snprintf(buffer, size, "%s-%d", name, index);
+    return buffer;
+}
+
+// Key written by previous versions: String("minLevel-" + i) is the string
+// literal shifted by i characters ("minLevel-", "inLevel-", ...)
+static const char *legacyProbeKey(char *buffer, size_t size, const char *name, uint8_t index)
+{
+    snprintf(buffer, size, "%s-", name);
+    return &buffer[min((size_t)index, strlen(buffer))];
+}
+
+static double getStored(Preferences &preferences, const SettingInfo &info, const char *key, double defaultValue)
+{
+    switch (info.storage)
+    {
+    case TYPE_INT8:   return preferences.getChar(key, defaultValue);
+    case TYPE_UINT8:  return preferences.getUChar(key, defaultValue);
+    case TYPE_UINT16: return preferences.getUShort(key, defaultValue);
+    case TYPE_INT32:  return preferences.getInt(key, defaultValue);
+    case TYPE_UINT64: return preferences.getULong64(key, defaultValue);
+    case TYPE_FLOAT:  return preferences.getFloat(key, defaultValue);
+    }
+    return defaultValue;
+}
+
+static void putStored(Preferences &preferences, const SettingInfo &info, const char *key, double raw)
+{
+    switch (info.storage)
+    {
+    case TYPE_INT8:   preferences.putChar(key, raw); break;
+    case TYPE_UINT8:  preferences.putUChar(key, raw); break;
+    case TYPE_UINT16: preferences.putUShort(key, raw); break;
+    case TYPE_INT32:  preferences.putInt(key, raw); break;
+    case TYPE_UINT64: preferences.putULong64(key, raw); break;
+    case TYPE_FLOAT:  preferences.putFloat(key, raw); break;
+    }
+}
+
+// Raw value of a setting in NVS, or its default
+static double loadStored(Preferences &preferences, const SettingInfo &info, uint8_t index)
+{
+    double defaultValue = info.defaultValue * info.scale;
+
+    if (!info.perProbe)
+    {
+        return getStored(preferences, info, info.key, defaultValue);
+    }
+
+    char buffer[16];
+    const char *key = probeKey(buffer, sizeof(buffer), info.key, index);
+
+    if (preferences.isKey(key))
+    {
+        return getStored(preferences, info, key, defaultValue);
+    }
+
+    // Written to the new key, and the legacy key removed, at the end of this wake
+    key = legacyProbeKey(buffer, sizeof(buffer), info.key, index);
+    if (preferences.isKey(key))
+    {
+        Log.noticeln(F("Migrating %s[%d] from legacy key %s"), info.name, index, key);
+        settingChanged(info.setting + index, true);
+        return getStored(preferences, info, key, defaultValue);
+    }
+
+    return defaultValue;
+}
+
+void settingChanged(uint8_t setting, bool urgent)
+{
+    settingsDirty |= 1ULL << setting;
+    settingsUrgent |= urgent;
+}
+
+void runChanged()
+{
+    // The run counter changes every cycle: only save it from time to time
+    if (run % RUN_CHECKPOINT_INTERVAL == 0)
+    {
+        settingChanged(SETTING_RUN);
+    }
+}
+
+void loadSettings(Preferences &preferences)
+{
+    unsigned long start = micros();
+
+    for (uint8_t i = 0; i < SETTING_TABLE_SIZE; i++)
+    {
+        const SettingInfo &info = SETTING_TABLE[i];
+        for (uint8_t index = 0; index < valueCount(info); index++)
+        {
+            double value = loadStored(preferences, info, index) / info.scale;
+
+            // Checking the recorded value (should only be useful on the first start)
+            if (isnan(value) || value < info.min || value > info.max)
+            {
+                Log.warningln(F("%s incorrect in Flash. Resetting to default"), info.name);
+                value = info.defaultValue;
+                settingChanged(info.setting + index);
+            }
+            setRaw(info, index, value * info.scale);
+        }
+    }
+    Log.noticeln(F("Sleep time %i s"), (int)(sleepTime / 1e6));
+
+    for (int i = 0; i < PROBE_COUNT; i++)
+    {
+        if (minLevel[i] == maxLevel[i])
+        {
+            Log.warningln(F("minLevel[%d] and maxLevel[%d] are the same: %d. Resetting to default"), i, i, maxLevel[i]);
+            minLevel[i] = CLOSEST;
+            maxLevel[i] = FARTHEST;
+            settingChanged(SETTING_MIN_LEVEL + i);
+            settingChanged(SETTING_MAX_LEVEL + i);
+        }
+
+        Log.noticeln(F("Levels[%d]: %d (deepest) - %d (highest)"), i, minLevel[i], maxLevel[i]);
+    }
+
+    if (run == 0)
+    {
+        Log.noticeln(F("Reading run from Flash"));
+        if (preferences.isKey("run"))
+        {
+            // The counter is only saved every RUN_CHECKPOINT_INTERVAL runs: skip the runs that may
+            // have happened since so that run numbers are not reused
+            run = (preferences.getUInt("run", 0) + RUN_CHECKPOINT_INTERVAL) % 100000;
+            settingChanged(SETTING_RUN);
+        }
+    }
+
+    nvsLoadTime = micros() - start;
+    configLoadSaved = 0;
+    schemaSent = false;
+    sealSettings();
+}
+
+bool commitSettings()
+{
+    if (settingsDirty == 0)
+    {
+        return true;
+    }
+
+    // Automatic changes (calibration, run counter) are grouped over several runs
+    if (!settingsUrgent && (run + 100000 - lastCommitRun) % 100000 < SETTINGS_COMMIT_INTERVAL)
+    {
+        Log.verboseln(F("Settings commit deferred (%d dirty)"), __builtin_popcountll(settingsDirty));
+        return false;
+    }
+
+    Preferences preferences;
+    if (!preferences.begin(SETTINGS_NAMESPACE, false))
+    {
+        Log.errorln(F("Unable to open preferences"));
+        return false;
+    }
+
+    char key[16];
+    uint8_t written = 0;
+    for (uint8_t i = 0; i < SETTING_TABLE_SIZE; i++)
+    {
+        const SettingInfo &info = SETTING_TABLE[i];
+        for (uint8_t index = 0; index < valueCount(info); index++)
+        {
+            if ((settingsDirty & (1ULL << (info.setting + index))) == 0)
+            {
+                continue;
+            }
+
+            const char *name = info.perProbe ? probeKey(key, sizeof(key), info.key, index) : info.key;
+            putStored(preferences, info, name, getRaw(info, index));
+            written++;
+
+            // The value migrated from a legacy key is now in the new one
+            if (info.perProbe)
+            {
+                name = legacyProbeKey(key, sizeof(key), info.key, index);
+                if (preferences.isKey(name))
+                {
+                    preferences.remove(name);
+                }
+            }
+        }
+    }
+
+    if (settingsDirty & (1ULL << SETTING_RUN))
+    {
+        preferences.putUInt("run", run);
+        written++;
+    }
+
+    preferences.end();
+    Log.verboseln(F("%d settings written to Flash"), written);
+
+    settingsDirty = 0;
+    settingsUrgent = false;
+    lastCommitRun = run;
+    return true;
+}
+
+// Setting matching a config key, with the probe index of "name[i]" keys
+const SettingInfo *findSetting(const char *name, uint8_t &index)
+{
+    size_t len = strlen(name);
+    index = 0;
+
+    // Check for indexed keys
+    if (len > 3 && name[len - 3] == '[' && isDigit(name[len - 2]) && name[len - 1] == ']')
+    {
+        index = name[len - 2] - '0';
+        len -= 3;
+    }
+
+    for (uint8_t i = 0; i < SETTING_TABLE_SIZE; i++)
+    {
+        const SettingInfo &info = SETTING_TABLE[i];
+        if (strncmp(name, info.name, len) == 0 && info.name[len] == 0)
+        {
+            if (index >= valueCount(info))
+            {
+                Log.errorln(F("Configuration impossible as index (%d) is higher than the number of values of %s (%d)."),
+                            index, info.name, valueCount(info));
+                return NULL;
+            }
+            return &info;
+        }
+    }
+
+    return NULL;
+}
+
+// Validate and store a value received in a config message. Returns true if the setting changed.
+bool applySetting(const SettingInfo *info, uint8_t index, double value)
+{
+    if (isnan(value))
+    {
+        Log.warningln(F("Incorrect %s value"), info->name);
+        return false;
+    }
+
+    if (value < info->min || value > info->max)
+    {
+        if (!info->clamp)
+        {
+            Log.warningln(F("Incorrect %s value. Must be between %D and %D"), info->name, info->min, info->max);
+            return false;
+        }
+
+        value = value < info->min ? info->min : info->max;
+        Log.warningln(F("%s out of range. Setting it to %D"), info->name, value);
+    }
+
+    // Compare in the unit of the variable, after the conversion
+    double previous = getRaw(*info, index);
+    setRaw(*info, index, value * info->scale);
+    if (getRaw(*info, index) == previous)
+    {
+        Log.verboseln(F("Value unchanged. Ignoring"));
+        return false;
+    }
+
+    settingChanged(info->setting + index, true);
+    if (info->onChange)
+    {
+        info->onChange();
+    }
+
+    if (info->perProbe)
+    {
+        Log.noticeln(F("New %s set for probe %d: %D"), info->name, index, value);
+    }
+    else
+    {
+        Log.noticeln(F("New %s set: %D"), info->name, value);
+    }
+    return true;
+}
+
+static size_t schemaEntry(char *buffer, size_t size, uint8_t i)
+{
+    const SettingInfo &info = SETTING_TABLE[i];
+    return snprintf(buffer, size, "%s\"%s\":{\"type\":\"%s\",\"min\":%g,\"max\":%g,\"default\":%g,\"count\":%d}",
+                    i == 0 ? "{" : ",", info.name, TYPE_NAMES[info.type], info.min, info.max, info.defaultValue,
+                    valueCount(info));
+}
+
+// Retained description of the settings, so that tools can build the config messages
+bool schemaPublish()
+{
+    if (schemaSent)
+    {
+        return true;
+    }
+
+    // Written entry by entry to keep the buffer small
+    char entry[160];
+    size_t len = 1;
+    for (uint8_t i = 0; i < SETTING_TABLE_SIZE; i++)
+    {
+        len += min(schemaEntry(entry, sizeof(entry), i), sizeof(entry) - 1);
+    }
+
+    bool sent = client.beginPublish(getTopic(TOPIC_CONFIG_SCHEMA), len, true);
+    for (uint8_t i = 0; sent && i < SETTING_TABLE_SIZE; i++)
+    {
+        size_t entryLen = min(schemaEntry(entry, sizeof(entry), i), sizeof(entry) - 1);
+        sent = client.write((const uint8_t *)entry, entryLen) == entryLen;
+    }
+    sent = sent && client.write('}') == 1 && client.endPublish();
+
+    if (!sent)
+    {
+        Log.errorln(F("Failed to send the settings schema"));
+        return false;
+    }
+
+    schemaSent = true;
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include "Arduino.h"
+#include "global_vars.h"
+#include "LogFloor.h"
+#include <Preferences.h>
+
+#define MAX_PROBES 8                    // probe-indexed settings have one dirty bit per probe
+#define SETTINGS_COMMIT_INTERVAL 10     // runs between 2 commits of automatic changes
+#define RUN_CHECKPOINT_INTERVAL 50      // runs between 2 saves of the run counter
+#define SETTINGS_VERSION 7              // change when the settings kept in RTC memory change
+
+static_assert(PROBE_COUNT <= MAX_PROBES, "Too many probes for the settings dirty bits");
+
+// Settings cached in RTC memory. Each one has a dirty bit.
+enum Setting {
+    SETTING_MIN_LEVEL = 0,              // + probe index
+    SETTING_MAX_LEVEL = SETTING_MIN_LEVEL + MAX_PROBES,
+    SETTING_SLEEP_TIME = SETTING_MAX_LEVEL + MAX_PROBES,
+    SETTING_SLEEP_TIME_ON_POWER,
+    SETTING_ON_POWER_THRESHOLD,
+    SETTING_MAX_DIFFERENCE,
+    SETTING_LOG_LEVEL,
+    SETTING_TEMPERATURE,
+    SETTING_BURST_SIZE,
+    SETTING_BURST_THRESHOLD,
+    SETTING_BATCH_SIZE,
+    SETTING_BATCH_DEPTH,
+    SETTING_PROFILE_INTERVAL,
+    SETTING_REPORT_DELTA,
+    SETTING_HEARTBEAT_INTERVAL,
+    SETTING_TELEMETRY_FORMAT,
+    SETTING_PERSISTENT_SESSION,
+    SETTING_DRAIN_TIMEOUT,
+    SETTING_LOG_LEVEL_SERIAL,
+    SETTING_LOG_LEVEL_FILE,
+    SETTING_LOG_LEVEL_MQTT,
+    SETTING_RUN,
+    SETTING_COUNT
+};
+
+static_assert(SETTING_COUNT <= 64, "Too many settings for the dirty mask");
+
+// Type of a setting variable, in RTC memory or in NVS
+enum SettingType {
+    TYPE_INT8 = 0,
+    TYPE_UINT8,
+    TYPE_UINT16,
+    TYPE_INT32,
+    TYPE_UINT64,
+    TYPE_FLOAT
+};
+
+// Description of a configurable setting. It drives the parsing of the config
+// messages, the validation, the NVS persistence and the published schema.
+// Ranges and default are in the unit of the config messages (value / scale).
+struct SettingInfo {
+    const char *name;                   // JSON key
+    const char *key;                    // NVS key, "-<probe>" is appended for probe settings
+    uint8_t     setting;                // dirty bit (first probe for probe settings)
+    uint8_t     type;                   // RTC variable
+    uint8_t     storage;                // NVS value
+    bool        perProbe;               // value is an array indexed by probe
+    bool        clamp;                  // out of range values are clamped instead of rejected
+    void       *value;                  // RTC variable
+    double      scale;                  // RTC value = config value * scale
+    double      min;
+    double      max;
+    double      defaultValue;
+    void      (*onChange)();
+};
+
+extern const SettingInfo SETTING_TABLE[];
+extern const uint8_t     SETTING_TABLE_SIZE;
+
+extern uint32_t configLoadSaved;
+
+const SettingInfo *findSetting(const char *name, uint8_t &index);
+bool applySetting(const SettingInfo *info, uint8_t index, double value);
+bool schemaPublish();
+
+bool settingsValid();
+void sealSettings();
+void loadSettings(Preferences &preferences);
+void settingChanged(uint8_t setting, bool urgent = false);
+void runChanged();
+void logLevelChanged();
+bool commitSettings();
+
+#endif
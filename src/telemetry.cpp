@@ -0,0 +1,93 @@
+#include "telemetry.h"
+#include "batch.h"
+#include "topics.h"
+
+/*************\
+ * Telemetry *
+\*************/
+
+// JSON header up to 70 characters, largest probe entry: ",[65535,-327.68,255]"
+static uint8_t telemetryMsg[80 + PROBE_COUNT * 24];
+
+static_assert(sizeof(TelemetryHeader) + PROBE_COUNT * sizeof(TelemetryProbe) <= sizeof(telemetryMsg),
+              "Telemetry buffer too small");
+
+// Filled level in hundredths of %
+static int16_t percentage(uint8_t index, long level)
+{
+    if (minLevel[index] == maxLevel[index])
+    {
+        return 0;
+    }
+    return (int16_t)((minLevel[index] - level) * 10000L / (minLevel[index] - maxLevel[index]));
+}
+
+static bool validLevel(long level)
+{
+    return level >= CLOSEST && level <= FARTHEST;
+}
+
+size_t serializeTelemetry(uint8_t format, const long *levels, float voltage, int8_t rssi)
+{
+    uint16_t millivolts = (uint16_t)(voltage * 1000);
+
+    if (format == TELEMETRY_BINARY)
+    {
+        TelemetryHeader *header = (TelemetryHeader *)telemetryMsg;
+        header->version = TELEMETRY_VERSION;
+        header->probeCount = PROBE_COUNT;
+        header->voltage = millivolts;
+        header->rssi = rssi;
+        header->failedConnection = failedConnection;
+        header->run = run;
+        header->buffered = batchCount();
+
+        TelemetryProbe *probes = (TelemetryProbe *)&telemetryMsg[sizeof(TelemetryHeader)];
+        for (uint8_t i = 0; i < PROBE_COUNT; i++)
+        {
+            bool valid = validLevel(levels[i]);
+            probes[i].level = valid ? levels[i] : 0;
+            probes[i].percentage = valid ? percentage(i, levels[i]) : 0;
+            probes[i].confidence = waterConfidence[i];
+        }
+
+        return sizeof(TelemetryHeader) + PROBE_COUNT * sizeof(TelemetryProbe);
+    }
+
+    // {"run":N,"mv":N,"rssi":N,"fail":N,"buf":N,"p":[[level,percentage,confidence],...]}
+    char *json = (char *)telemetryMsg;
+    size_t len = snprintf(json, sizeof(telemetryMsg), "{\"run\":%lu,\"mv\":%u,\"rssi\":%d,\"fail\":%u,\"buf\":%u,\"p\":[",
+                          (unsigned long)run, millivolts, rssi, failedConnection, batchCount());
+
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
+    {
+        const char *separator = i == 0 ? "" : ",";
+        if (!validLevel(levels[i]))
+        {
+            len += snprintf(&json[len], sizeof(telemetryMsg) - len, "%snull", separator);
+            continue;
+        }
+
+        int16_t pct = percentage(i, levels[i]);
+        len += snprintf(&json[len], sizeof(telemetryMsg) - len, "%s[%ld,%s%d.%02d,%u]", separator, levels[i],
+                        pct < 0 ? "-" : "", abs(pct) / 100, abs(pct) % 100, waterConfidence[i]);
+    }
+    len += snprintf(&json[len], sizeof(telemetryMsg) - len, "]}");
+
+    return len;
+}
+
+bool telemetryPublish(const long *levels, float voltage, int8_t rssi)
+{
+    unsigned long start = micros();
+    size_t len = serializeTelemetry(telemetryFormat, levels, voltage, rssi);
+    Log.verboseln(F("State serialized in %l us (%d bytes)"), micros() - start, len);
+
+    if (!client.publish(getTopic(TOPIC_STATE), telemetryMsg, len, true))
+    {
+        Log.errorln(F("Failed to send state"));
+        return false;
+    }
+
+    return true;
+}
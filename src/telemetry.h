@@ -0,0 +1,35 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "Arduino.h"
+#include "global_vars.h"
+#include "LogFloor.h"
+
+// Report formats
+#define TELEMETRY_TOPICS 0              // one topic per value (legacy)
+#define TELEMETRY_JSON   1              // one JSON message on ROOT_TOPIC/state
+#define TELEMETRY_BINARY 2              // one binary message on ROOT_TOPIC/state
+
+#define TELEMETRY_VERSION 1
+
+// Binary layout, little endian
+struct __attribute__((packed)) TelemetryHeader {
+    uint8_t  version;                   // TELEMETRY_VERSION
+    uint8_t  probeCount;
+    uint16_t voltage;                   // mV
+    int8_t   rssi;                      // dBm
+    uint8_t  failedConnection;
+    uint32_t run;
+    uint16_t buffered;                  // readings waiting in the batch buffer
+};
+
+struct __attribute__((packed)) TelemetryProbe {
+    uint16_t level;                     // mm, 0 if the measure is invalid
+    int16_t  percentage;                // hundredths of %
+    uint8_t  confidence;                // %
+};
+
+size_t serializeTelemetry(uint8_t format, const long *levels, float voltage, int8_t rssi);
+bool   telemetryPublish(const long *levels, float voltage, int8_t rssi);
+
+#endif
@@ -0,0 +1,79 @@
+#include "topics.h"
+
+/**********\
+ * Topics *
+\**********/
+
+static char topics[TOPIC_COUNT][TOPIC_MAX_LENGTH];
+static size_t rootLength = 0;
+
+// Topic followed by a variable part (file name, ...)
+static char topicBuffer[TOPIC_MAX_LENGTH * 2];
+
+// Suffixes of the topics not indexed by probe, in TopicId order
+static const char *const TOPIC_SUFFIXES[TOPIC_LEVEL] = {
+    "config",
+    "update/url",
+    "file/get",
+    "file/dirlist",
+    "sync",
+    "rpc/request",
+    "log",
+    "alert",
+    "voltage",
+    "availability",
+    "state",
+    "batch",
+    "stats/profile",
+    "config/schema",
+    "rpc/response",
+    "file/data",
+    "file/dir",
+};
+
+void initTopics()
+{
+    rootLength = ROOT_TOPIC.length();
+
+    for (uint8_t id = 0; id < TOPIC_LEVEL; id++)
+    {
+        snprintf(topics[id], TOPIC_MAX_LENGTH, "%s/%s", ROOT_TOPIC.c_str(), TOPIC_SUFFIXES[id]);
+    }
+
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
+    {
+        snprintf(topics[TOPIC_LEVEL + i], TOPIC_MAX_LENGTH, "%s/level%d", ROOT_TOPIC.c_str(), i);
+        snprintf(topics[TOPIC_LEVEL_PERCENTAGE + i], TOPIC_MAX_LENGTH, "%s/level%dPercentage", ROOT_TOPIC.c_str(), i);
+    }
+}
+
+const char *getTopic(uint8_t id)
+{
+    return topics[id];
+}
+
+const char *topicWith(uint8_t id, const char *suffix)
+{
+    snprintf(topicBuffer, sizeof(topicBuffer), "%s%s", topics[id], suffix);
+    return topicBuffer;
+}
+
+int8_t topicId(const char *name)
+{
+    // Only the subscribed topics can be received
+    if (strncmp(name, topics[0], rootLength + 1) != 0)
+    {
+        return TOPIC_UNKNOWN;
+    }
+
+    const char *suffix = &name[rootLength + 1];
+    for (uint8_t id = 0; id < TOPIC_SUBSCRIBED_COUNT; id++)
+    {
+        if (strcmp(suffix, TOPIC_SUFFIXES[id]) == 0)
+        {
+            return id;
+        }
+    }
+
+    return TOPIC_UNKNOWN;
+}
@@ -0,0 +1,44 @@
+#ifndef TOPICS_H
+#define TOPICS_H
+
+#include "Arduino.h"
+#include "global_vars.h"
+
+#define TOPIC_MAX_LENGTH 64
+
+// MQTT topics, built once at boot under ROOT_TOPIC
+enum TopicId {
+    // Subscribed
+    TOPIC_CONFIG = 0,
+    TOPIC_UPDATE_URL,
+    TOPIC_FILE_GET,
+    TOPIC_FILE_DIRLIST,
+    TOPIC_SYNC,                         // drain marker, echoed by the broker
+    TOPIC_RPC_REQUEST,
+    TOPIC_SUBSCRIBED_COUNT,
+
+    // Published
+    TOPIC_LOG = TOPIC_SUBSCRIBED_COUNT,
+    TOPIC_ALERT,
+    TOPIC_VOLTAGE,
+    TOPIC_AVAILABILITY,
+    TOPIC_STATE,
+    TOPIC_BATCH,
+    TOPIC_STATS_PROFILE,
+    TOPIC_CONFIG_SCHEMA,
+    TOPIC_RPC_RESPONSE,                 // + "/<request id>"
+    TOPIC_FILE_DATA,
+    TOPIC_FILE_DIR,
+    TOPIC_LEVEL,                        // + probe index
+    TOPIC_LEVEL_PERCENTAGE = TOPIC_LEVEL + PROBE_COUNT,
+    TOPIC_COUNT = TOPIC_LEVEL_PERCENTAGE + PROBE_COUNT
+};
+
+#define TOPIC_UNKNOWN -1
+
+void        initTopics();
+const char *getTopic(uint8_t id);
+const char *topicWith(uint8_t id, const char *suffix);
+int8_t      topicId(const char *name);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef STUB_ARDUINO_H
+#define STUB_ARDUINO_H
+
+// Host stand-in for the Arduino core, enough to build the modules under test
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "Print.h"
+#include "esp_log.h"
+#include "stub_clock.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+using std::isnan;
+using std::max;
+using std::min;
+
+#define RTC_DATA_ATTR
+#define IRAM_ATTR
+#define F(s) ((const __FlashStringHelper *)(s))
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define CHANGE 3
+
+typedef uint8_t byte;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline unsigned long micros() { return (unsigned long)stubMicros.load(); }
+inline unsigned long millis() { return (unsigned long)(stubMicros.load() / 1000); }
+inline void delay(uint32_t ms) { stubMicros += (int64_t)ms * 1000; }
+inline void delayMicroseconds(uint32_t us) { stubMicros += us; }
+
+inline long random(long max) { return rand() % max; }
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// The pin configuration calls, in order
+struct StubPinCall {
+    char    call;                       // 'M' pinMode, 'W' digitalWrite
+    uint8_t pin;
+    uint8_t value;
+};
+
+inline std::vector<StubPinCall> stubPinCalls;
+
+inline void pinMode(uint8_t pin, uint8_t mode) { stubPinCalls.push_back({'M', pin, mode}); }
+inline void digitalWrite(uint8_t pin, uint8_t value) { stubPinCalls.push_back({'W', pin, value}); }
+inline int digitalRead(uint8_t) { return LOW; }
+inline uint16_t analogRead(uint8_t) { return 0; }
+inline float temperatureRead() { return 20; }
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+inline void attachInterrupt(uint8_t, void (*)(), int) {}
+inline void detachInterrupt(uint8_t) {}
+
+// Part of the C library on the device
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+inline size_t strlcpy(char *destination, const char *source, size_t size)
+{
+    size_t length = strlen(source);
+    if (size > 0)
+    {
+        size_t count = std::min(length, size - 1);
+        memcpy(destination, source, count);
+        destination[count] = 0;
+    }
+    return length;
+}
+#endif
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_DEEPSLEEP = 8,
+} esp_reset_reason_t;
+
+inline esp_reset_reason_t esp_reset_reason() { return ESP_RST_DEEPSLEEP; }
+
+class EspClass
+{
+    public:
+        uint32_t getFreeHeap() { return 200000; }
+        uint32_t getMinFreeHeap() { return 150000; }
+        void restart() {}
+};
+
+inline EspClass ESP;
+
+#endif
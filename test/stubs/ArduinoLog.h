@@ -0,0 +1,131 @@
+#ifndef STUB_ARDUINO_LOG_H
+#define STUB_ARDUINO_LOG_H
+
+#include "Arduino.h"
+
+// Same levels, output and conversions as ArduinoLog 1.1, so that the cost of
+// formatting a line is close to the real one. The integer conversions read
+// 32 bit values like on the ESP32.
+
+#define LOG_LEVEL_SILENT  0
+#define LOG_LEVEL_FATAL   1
+#define LOG_LEVEL_ERROR   2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_NOTICE  4
+#define LOG_LEVEL_TRACE   5
+#define LOG_LEVEL_VERBOSE 6
+
+#define CR "\n"
+
+typedef void (*printfunction)(Print *, int);
+
+class Logging
+{
+    private:
+        int _level = LOG_LEVEL_SILENT;
+        bool _showLevel = true;
+        Print *_logOutput = nullptr;
+        printfunction _prefix = nullptr;
+        printfunction _suffix = nullptr;
+
+        void print(const __FlashStringHelper *format, va_list args) { print((const char *)format, args); }
+        void print(const char *format, va_list args)
+        {
+            // A va_list parameter is a pointer on x86-64, printFormat() needs the list itself
+            va_list list;
+            va_copy(list, args);
+            for (; *format != 0; ++format)
+            {
+                if (*format == '%')
+                {
+                    ++format;
+                    printFormat(*format, &list);
+                }
+                else
+                {
+                    _logOutput->print(*format);
+                }
+            }
+            va_end(list);
+        }
+
+        void printFormat(const char format, va_list *args)
+        {
+            switch (format)
+            {
+            case '\0': return;
+            case '%': _logOutput->print(format); break;
+            case 's': _logOutput->print(va_arg(*args, char *)); break;
+            case 'S': _logOutput->print(va_arg(*args, const __FlashStringHelper *)); break;
+            case 'd':
+            case 'i': _logOutput->print(va_arg(*args, int), DEC); break;
+            case 'D':
+            case 'F': _logOutput->print(va_arg(*args, double)); break;
+            case 'x': _logOutput->print(va_arg(*args, int), HEX); break;
+            case 'X': _logOutput->print("0x"); _logOutput->print(va_arg(*args, int), HEX); break;
+            case 'b': _logOutput->print(va_arg(*args, int), BIN); break;
+            case 'B': _logOutput->print("0b"); _logOutput->print(va_arg(*args, int), BIN); break;
+            case 'l': _logOutput->print(va_arg(*args, int), DEC); break;
+            case 'u': _logOutput->print(va_arg(*args, unsigned int), DEC); break;
+            case 'c': _logOutput->print((char)va_arg(*args, int)); break;
+            case 't': _logOutput->print(va_arg(*args, int) ? 'T' : 'F'); break;
+            case 'T': _logOutput->print(va_arg(*args, int) ? "true" : "false"); break;
+            case 'p': _logOutput->print(*va_arg(*args, Printable *)); break;
+            default: _logOutput->print('%'); _logOutput->print(format); break;
+            }
+        }
+
+        template <class T> void printLevel(int level, bool cr, T msg, ...)
+        {
+            if (level > _level)
+            {
+                return;
+            }
+            if (_prefix != nullptr)
+            {
+                _prefix(_logOutput, level);
+            }
+            if (_showLevel)
+            {
+                static const char levels[] = "FEWITV";
+                _logOutput->print(levels[level - 1]);
+                _logOutput->print(": ");
+            }
+            va_list args;
+            va_start(args, msg);
+            print(msg, args);
+            va_end(args);
+            if (_suffix != nullptr)
+            {
+                _suffix(_logOutput, level);
+            }
+            if (cr)
+            {
+                _logOutput->print(CR);
+            }
+        }
+
+    public:
+        void begin(int level, Print *output, bool showLevel = true)
+        {
+            setLevel(level);
+            _logOutput = output;
+            _showLevel = showLevel;
+        }
+        void setLevel(int level) { _level = constrain(level, LOG_LEVEL_SILENT, LOG_LEVEL_VERBOSE); }
+        int getLevel() { return _level; }
+        void setShowLevel(bool showLevel) { _showLevel = showLevel; }
+        void setPrefix(printfunction f) { _prefix = f; }
+        void setSuffix(printfunction f) { _suffix = f; }
+
+        template <class T, typename... Args> void fatalln(T msg, Args... args) { printLevel(LOG_LEVEL_FATAL, true, msg, args...); }
+        template <class T, typename... Args> void errorln(T msg, Args... args) { printLevel(LOG_LEVEL_ERROR, true, msg, args...); }
+        template <class T, typename... Args> void warningln(T msg, Args... args) { printLevel(LOG_LEVEL_WARNING, true, msg, args...); }
+        template <class T, typename... Args> void noticeln(T msg, Args... args) { printLevel(LOG_LEVEL_NOTICE, true, msg, args...); }
+        template <class T, typename... Args> void traceln(T msg, Args... args) { printLevel(LOG_LEVEL_TRACE, true, msg, args...); }
+        template <class T, typename... Args> void verboseln(T msg, Args... args) { printLevel(LOG_LEVEL_VERBOSE, true, msg, args...); }
+};
+
+inline Logging Log;
+
+#endif
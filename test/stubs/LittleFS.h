@@ -0,0 +1,113 @@
+#ifndef STUB_LITTLE_FS_H
+#define STUB_LITTLE_FS_H
+
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include "Arduino.h"
+
+// Host stand-in for LittleFS: the partition is a directory of the computer,
+// mounted at the base path as the VFS does on the device, so that the POSIX
+// calls of files.cpp see the same files. A test sets BASE_PATH to a directory
+// of its own.
+class File : public Print
+{
+    public:
+        File() {}
+        File(FILE *stream, bool isDir) : stream(stream, fclose), isDir(isDir) {}
+        File(bool isDir) : isDir(isDir) {}
+
+        explicit operator bool() const { return stream != nullptr || isDir; }
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *buffer, size_t size) override
+        {
+            return stream ? fwrite(buffer, 1, size, stream.get()) : 0;
+        }
+
+        size_t read(uint8_t *buffer, size_t size) { return stream ? fread(buffer, 1, size, stream.get()) : 0; }
+        size_t readBytes(char *buffer, size_t size) { return read((uint8_t *)buffer, size); }
+        bool seek(uint32_t position) { return stream && fseek(stream.get(), position, SEEK_SET) == 0; }
+
+        size_t size()
+        {
+            struct stat info;
+            flush();
+            return stream && fstat(fileno(stream.get()), &info) == 0 ? info.st_size : 0;
+        }
+
+        void flush() override
+        {
+            if (stream)
+            {
+                fflush(stream.get());
+            }
+        }
+
+        void close()
+        {
+            stream.reset();
+            isDir = false;
+        }
+
+        bool isDirectory() { return isDir; }
+
+    private:
+        std::shared_ptr<FILE> stream;
+        bool isDir = false;
+};
+
+class LittleFSFS
+{
+    public:
+        int mounts = 0;                 // successful begin() calls
+
+        bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+                   const char *partitionLabel = "spiffs")
+        {
+            if (mkdir(basePath, 0755) != 0 && errno != EEXIST)
+            {
+                return false;
+            }
+            root = basePath;
+            mounts++;
+            return true;
+        }
+
+        void end() { root.clear(); }
+
+        bool exists(const char *path)
+        {
+            struct stat info;
+            return !root.empty() && stat((root + path).c_str(), &info) == 0;
+        }
+        bool exists(const String &path) { return exists(path.c_str()); }
+
+        File open(const char *path, const char *mode = "r")
+        {
+            struct stat info;
+            if (root.empty())
+            {
+                return File();
+            }
+            if (stat((root + path).c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+            {
+                return File(true);
+            }
+            FILE *stream = fopen((root + path).c_str(), mode[0] == 'w' ? "wb+" : mode[0] == 'a' ? "ab+" : "rb");
+            return stream ? File(stream, false) : File();
+        }
+        File open(const String &path, const char *mode = "r") { return open(path.c_str(), mode); }
+
+        bool remove(const char *path) { return !root.empty() && ::remove((root + path).c_str()) == 0; }
+        bool remove(const String &path) { return remove(path.c_str()); }
+
+    private:
+        std::string root;               // empty when not mounted
+};
+
+inline LittleFSFS LittleFS;
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef STUB_PREFERENCES_H
+#define STUB_PREFERENCES_H
+
+#include <map>
+#include <string>
+#include "Arduino.h"
+
+// NVS in memory. The values outlive the Preferences objects like the flash
+// does, and every put is counted to follow the flash wear.
+class Preferences
+{
+    private:
+        std::string name;
+
+        static std::map<std::string, double> &values()
+        {
+            static std::map<std::string, double> nvs;
+            return nvs;
+        }
+
+        std::string path(const char *key) const { return name + "/" + key; }
+
+        double get(const char *key, double defaultValue) const
+        {
+            auto found = values().find(path(key));
+            return found == values().end() ? defaultValue : found->second;
+        }
+
+        size_t put(const char *key, double value, size_t size)
+        {
+            values()[path(key)] = value;
+            writes++;
+            return size;
+        }
+
+    public:
+        static inline uint32_t writes = 0;
+
+        static void erase()
+        {
+            values().clear();
+            writes = 0;
+        }
+
+        bool begin(const char *nvsName, bool readOnly = false)
+        {
+            (void)readOnly;
+            name = nvsName;
+            return true;
+        }
+        void end() {}
+
+        bool isKey(const char *key) const { return values().count(path(key)) > 0; }
+
+        bool remove(const char *key)
+        {
+            writes++;
+            return values().erase(path(key)) > 0;
+        }
+
+        int8_t getChar(const char *key, int8_t defaultValue = 0) { return get(key, defaultValue); }
+        uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return get(key, defaultValue); }
+        uint16_t getUShort(const char *key, uint16_t defaultValue = 0) { return get(key, defaultValue); }
+        int32_t getInt(const char *key, int32_t defaultValue = 0) { return get(key, defaultValue); }
+        uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+        uint64_t getULong64(const char *key, uint64_t defaultValue = 0) { return get(key, defaultValue); }
+        float getFloat(const char *key, float defaultValue = NAN) { return get(key, defaultValue); }
+
+        size_t putChar(const char *key, int8_t value) { return put(key, value, 1); }
+        size_t putUChar(const char *key, uint8_t value) { return put(key, value, 1); }
+        size_t putUShort(const char *key, uint16_t value) { return put(key, value, 2); }
+        size_t putInt(const char *key, int32_t value) { return put(key, value, 4); }
+        size_t putUInt(const char *key, uint32_t value) { return put(key, value, 4); }
+        size_t putULong64(const char *key, uint64_t value) { return put(key, value, 8); }
+        size_t putFloat(const char *key, float value) { return put(key, value, 4); }
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef STUB_PRINT_H
+#define STUB_PRINT_H
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print;
+class __FlashStringHelper;
+
+class Printable
+{
+    public:
+        virtual ~Printable() {}
+        virtual size_t printTo(Print &p) const = 0;
+};
+
+class String
+{
+    private:
+        std::string value;
+
+    public:
+        String(const char *s = "") : value(s) {}
+        String(const std::string &s) : value(s) {}
+        const char *c_str() const { return value.c_str(); }
+        unsigned int length() const { return value.size(); }
+        bool operator==(const char *s) const { return value == s; }
+        String operator+(const char *s) const { return String(value + s); }
+};
+
+// Same overloads as the Arduino Print class, enough for the code under test
+class Print
+{
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t *buffer, size_t size)
+        {
+            size_t n = 0;
+            while (size--)
+            {
+                n += write(*buffer++);
+            }
+            return n;
+        }
+        size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+        virtual void flush() {}
+
+        size_t print(const char *s) { return write(s); }
+        size_t print(const __FlashStringHelper *s) { return write((const char *)s); }
+        size_t print(const String &s) { return write(s.c_str()); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(const Printable &p) { return p.printTo(*this); }
+        size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+        size_t print(int n, int base = DEC) { return print((long)n, base); }
+        size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+        size_t print(long n, int base = DEC)
+        {
+            if (base == DEC && n < 0)
+            {
+                return print('-') + print((unsigned long)-n, base);
+            }
+            return print((unsigned long)n, base);
+        }
+        size_t print(unsigned long n, int base = DEC)
+        {
+            char buffer[8 * sizeof(long) + 1];
+            char *p = &buffer[sizeof(buffer) - 1];
+            *p = 0;
+            do
+            {
+                unsigned digit = n % base;
+                *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+                n /= base;
+            } while (n);
+            return write(p);
+        }
+        size_t print(double n, int digits = 2)
+        {
+            char buffer[40];
+            snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+            return write(buffer);
+        }
+
+        template <class T> size_t println(T value) { return print(value) + println(); }
+        size_t println() { return write("\r\n"); }
+
+        size_t printf(const char *format, ...)
+        {
+            char buffer[256];
+            va_list args;
+            va_start(args, format);
+            int n = vsnprintf(buffer, sizeof(buffer), format, args);
+            va_end(args);
+            return write((const uint8_t *)buffer, n < (int)sizeof(buffer) ? n : sizeof(buffer) - 1);
+        }
+};
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef STUB_PUB_SUB_CLIENT_H
+#define STUB_PUB_SUB_CLIENT_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "WiFi.h"
+
+#define MQTT_MAX_PACKET_SIZE 256
+
+typedef void (*MqttCallback)(char *topic, uint8_t *payload, unsigned int length);
+
+// Records the published messages instead of sending them. A broker on the other
+// side keeps the session of a client that connects without clean session, as
+// MQTT does: its subscriptions, and its QoS 1 messages while it sleeps. The
+// retained messages are sent to each new subscription.
+class PubSubClient : public Print
+{
+    public:
+        struct Message {
+            std::string topic;
+            std::string payload;
+            bool retained;
+        };
+
+        struct Subscription {
+            std::string topic;
+            uint8_t     qos;
+        };
+
+        std::vector<Message> messages;
+        bool online = true;             // connected, and the messages go through
+        bool linked = true;             // false between disconnect() and connect()
+
+        // Broker side
+        std::string               sessionId;       // client of the kept session
+        bool                      sessionPresent = false;
+        std::vector<Subscription> subscriptions;
+        std::vector<Subscription> subscribed;      // SUBSCRIBE packets sent
+        std::vector<Message>      incoming;        // waiting for loop()
+        std::map<std::string, std::string> retainedMessages;  // last retained message of each topic
+        std::string               lastClientId;
+
+        PubSubClient() {}
+        PubSubClient(WiFiClient &) {}
+
+        PubSubClient &setServer(IPAddress, uint16_t) { return *this; }
+        PubSubClient &setCallback(MqttCallback handler)
+        {
+            callback = handler;
+            return *this;
+        }
+
+        bool connect(const char *id, const char *, const char *, const char *, uint8_t, bool, const char *,
+                     bool cleanSession)
+        {
+            if (!online)
+            {
+                return false;
+            }
+
+            lastClientId = id;
+            sessionPresent = !cleanSession && sessionId == id;
+            if (!sessionPresent)
+            {
+                subscriptions.clear();
+                incoming.clear();
+            }
+            sessionId = cleanSession ? "" : id;
+            linked = true;
+            return true;
+        }
+
+        void disconnect()
+        {
+            linked = false;
+            if (sessionId.empty())
+            {
+                subscriptions.clear();
+            }
+        }
+
+        bool subscribe(const char *topic, uint8_t qos)
+        {
+            subscribed.push_back({topic, qos});
+            subscriptions.push_back({topic, qos});
+            auto message = retainedMessages.find(topic);
+            if (message != retainedMessages.end())
+            {
+                incoming.push_back({topic, message->second, true});
+            }
+            return connected();
+        }
+
+        int state() { return connected() ? 0 : -2; }
+        bool connected() { return online && linked; }
+
+        // Message published by another client: delivered now if connected, kept
+        // by the broker in a persistent session if subscribed with QoS 1. An
+        // empty retained message removes the one of the topic.
+        void deliver(const char *topic, const std::string &payload, bool retain = false)
+        {
+            if (retain && payload.empty())
+            {
+                retainedMessages.erase(topic);
+            }
+            else if (retain)
+            {
+                retainedMessages[topic] = payload;
+            }
+
+            for (const Subscription &subscription : subscriptions)
+            {
+                if (subscription.topic == topic && (connected() || subscription.qos > 0))
+                {
+                    incoming.push_back({topic, payload, retain});
+                    return;
+                }
+            }
+        }
+
+        bool loop()
+        {
+            while (connected() && !incoming.empty() && callback)
+            {
+                Message message = incoming.front();
+                incoming.erase(incoming.begin());
+
+                // As in the library, the payload is followed by room for a terminating 0
+                std::vector<uint8_t> buffer(message.payload.begin(), message.payload.end());
+                buffer.push_back(0);
+                callback((char *)message.topic.c_str(), buffer.data(), message.payload.size());
+            }
+            return connected();
+        }
+
+        bool publish(const char *topic, const char *payload, bool retained = false)
+        {
+            return publish(topic, (const uint8_t *)payload, strlen(payload), retained);
+        }
+
+        bool publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained = false)
+        {
+            if (!connected())
+            {
+                return false;
+            }
+            messages.push_back({topic, std::string((const char *)payload, length), retained});
+            deliver(topic, messages.back().payload, retained);
+            return true;
+        }
+
+        // Streamed message: the length announced must be the length written
+        bool beginPublish(const char *topic, unsigned int length, bool retained)
+        {
+            if (!online)
+            {
+                return false;
+            }
+            pending = {topic, std::string(), retained};
+            pendingLength = length;
+            return true;
+        }
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+
+        size_t write(const uint8_t *buffer, size_t size) override
+        {
+            if (!online)
+            {
+                return 0;
+            }
+            pending.payload.append((const char *)buffer, size);
+            return size;
+        }
+
+        int endPublish()
+        {
+            if (!online || pending.payload.size() != pendingLength)
+            {
+                return 0;
+            }
+            messages.push_back(pending);
+            deliver(pending.topic.c_str(), pending.payload, pending.retained);
+            return 1;
+        }
+
+        // Payloads published on a topic, oldest first
+        std::vector<std::string> payloads(const char *topic) const
+        {
+            std::vector<std::string> found;
+            for (const Message &message : messages)
+            {
+                if (message.topic == topic)
+                {
+                    found.push_back(message.payload);
+                }
+            }
+            return found;
+        }
+
+    private:
+        MqttCallback callback = NULL;
+        Message pending;
+        size_t pendingLength = 0;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef STUB_WIFI_H
+#define STUB_WIFI_H
+
+#include "Arduino.h"
+
+class IPAddress
+{
+    public:
+        uint8_t bytes[4] = {0, 0, 0, 0};
+
+        IPAddress() {}
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+};
+
+class WiFiClient
+{
+};
+
+class WiFiClass
+{
+    public:
+        uint8_t mac[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+        int8_t  rssi = -67;
+
+        int8_t RSSI() { return rssi; }
+
+        uint8_t *macAddress(uint8_t *address)
+        {
+            memcpy(address, mac, sizeof(mac));
+            return address;
+        }
+};
+
+inline WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef STUB_ESP_LITTLEFS_H
+#define STUB_ESP_LITTLEFS_H
+
+#include "esp_err.h"
+
+// The directory of the stand-in LittleFS is never corrupted
+inline esp_err_t esp_littlefs_format(const char *partition_label) { return ESP_FAIL; }
+
+#endif
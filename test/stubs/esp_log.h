@@ -0,0 +1,22 @@
+#ifndef STUB_ESP_LOG_H
+#define STUB_ESP_LOG_H
+
+#include <cstdarg>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+typedef int (*vprintf_like_t)(const char *, va_list);
+
+inline esp_log_level_t stubEspLogLevel = ESP_LOG_INFO;
+
+inline void esp_log_level_set(const char *, esp_log_level_t level) { stubEspLogLevel = level; }
+inline vprintf_like_t esp_log_set_vprintf(vprintf_like_t) { return nullptr; }
+
+#endif
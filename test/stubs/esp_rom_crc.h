@@ -0,0 +1,22 @@
+#ifndef STUB_ESP_ROM_CRC_H
+#define STUB_ESP_ROM_CRC_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Same CRC as the ROM (IEEE 802.3, reflected)
+inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buffer, size_t length)
+{
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *buffer++;
+        for (int i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+#endif
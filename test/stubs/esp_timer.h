@@ -0,0 +1,8 @@
+#ifndef STUB_ESP_TIMER_H
+#define STUB_ESP_TIMER_H
+
+#include "Arduino.h"
+
+inline int64_t esp_timer_get_time() { return stubMicros.load(); }
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef STUB_FREERTOS_H
+#define STUB_FREERTOS_H
+
+// FreeRTOS on host threads. A tick is a millisecond of real time, vTaskDelay()
+// also moves the simulated clock so that the timeouts on millis() run out.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY 0xFFFFFFFFu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskIDLE_PRIORITY 0
+
+// Critical sections are a recursive lock, there is no interrupt context
+struct portMUX_TYPE {
+    std::recursive_mutex lock;
+};
+
+#define portMUX_INITIALIZER_UNLOCKED portMUX_TYPE()
+#define portENTER_CRITICAL(mux) (mux)->lock.lock()
+#define portEXIT_CRITICAL(mux) (mux)->lock.unlock()
+#define portENTER_CRITICAL_SAFE(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_SAFE(mux) portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR()
+
+inline bool xPortInIsrContext() { return false; }
+
+// Waits on a condition for a number of ticks
+template <class Predicate>
+bool stubWait(std::condition_variable &cv, std::unique_lock<std::mutex> &lock, TickType_t ticks, Predicate ready)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        cv.wait(lock, ready);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+#endif
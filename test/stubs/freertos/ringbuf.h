@@ -0,0 +1,87 @@
+#ifndef STUB_FREERTOS_RINGBUF_H
+#define STUB_FREERTOS_RINGBUF_H
+
+#include <deque>
+#include <vector>
+#include "FreeRTOS.h"
+
+typedef enum {
+    RINGBUF_TYPE_NOSPLIT = 0,
+    RINGBUF_TYPE_ALLOWSPLIT,
+    RINGBUF_TYPE_BYTEBUF
+} RingbufferType_t;
+
+// No-split ring buffer: items are 4 byte aligned with an 8 byte header, like
+// the ESP-IDF one, so that the free space runs out at the same rate
+struct StubRingbuffer {
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> items;
+    std::vector<uint8_t> received;      // item lent to the reader until it is returned
+    size_t size;
+    size_t used = 0;
+};
+
+typedef StubRingbuffer *RingbufHandle_t;
+
+inline size_t stubItemSize(size_t length) { return (length + 3) / 4 * 4 + 8; }
+
+inline RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t)
+{
+    RingbufHandle_t ring = new StubRingbuffer();
+    ring->size = size;
+    return ring;
+}
+
+inline void vRingbufferDelete(RingbufHandle_t ring) { delete ring; }
+
+inline BaseType_t xRingbufferSend(RingbufHandle_t ring, const void *data, size_t length, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(ring->lock);
+    size_t needed = stubItemSize(length);
+    if (!stubWait(ring->cv, lock, ticks, [=] { return ring->used + needed <= ring->size; }))
+    {
+        return pdFALSE;
+    }
+    ring->items.emplace_back((const uint8_t *)data, (const uint8_t *)data + length);
+    ring->used += needed;
+    ring->cv.notify_all();
+    return pdTRUE;
+}
+
+inline BaseType_t xRingbufferSendFromISR(RingbufHandle_t ring, const void *data, size_t length, BaseType_t *woken)
+{
+    if (woken)
+    {
+        *woken = pdFALSE;
+    }
+    return xRingbufferSend(ring, data, length, 0);
+}
+
+inline void *xRingbufferReceive(RingbufHandle_t ring, size_t *length, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(ring->lock);
+    if (!stubWait(ring->cv, lock, ticks, [=] { return !ring->items.empty(); }))
+    {
+        return nullptr;
+    }
+    ring->received = std::move(ring->items.front());
+    ring->items.pop_front();
+    *length = ring->received.size();
+    return ring->received.data();
+}
+
+inline void vRingbufferReturnItem(RingbufHandle_t ring, void *)
+{
+    std::lock_guard<std::mutex> guard(ring->lock);
+    ring->used -= stubItemSize(ring->received.size());
+    ring->cv.notify_all();
+}
+
+inline size_t xRingbufferGetCurFreeSize(RingbufHandle_t ring)
+{
+    std::lock_guard<std::mutex> guard(ring->lock);
+    return ring->size - ring->used;
+}
+
+#endif
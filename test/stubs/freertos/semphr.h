@@ -0,0 +1,45 @@
+#ifndef STUB_FREERTOS_SEMPHR_H
+#define STUB_FREERTOS_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+// Counting semaphore, a mutex starts with one token
+struct StubSemaphore {
+    std::mutex lock;
+    std::condition_variable cv;
+    UBaseType_t count = 0;
+};
+
+typedef StubSemaphore *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return new StubSemaphore(); }
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    SemaphoreHandle_t semaphore = new StubSemaphore();
+    semaphore->count = 1;
+    return semaphore;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(semaphore->lock);
+    if (!stubWait(semaphore->cv, lock, ticks, [=] { return semaphore->count > 0; }))
+    {
+        return pdFALSE;
+    }
+    semaphore->count--;
+    return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> guard(semaphore->lock);
+    semaphore->count++;
+    semaphore->cv.notify_all();
+    return pdTRUE;
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef STUB_FREERTOS_TASK_H
+#define STUB_FREERTOS_TASK_H
+
+#include <atomic>
+#include <thread>
+#include "FreeRTOS.h"
+#include "../stub_clock.h"
+
+struct StubTask {
+    std::mutex lock;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+    UBaseType_t priority = 1;
+};
+
+typedef StubTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+inline TaskHandle_t &stubCurrentTask()
+{
+    // The test thread plays the Arduino loop task
+    static StubTask loopTask;
+    thread_local TaskHandle_t current = &loopTask;
+    return current;
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return stubCurrentTask(); }
+
+inline UBaseType_t uxTaskPriorityGet(TaskHandle_t task) { return (task ? task : stubCurrentTask())->priority; }
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char *, uint32_t, void *parameter, UBaseType_t priority,
+                              TaskHandle_t *handle)
+{
+    TaskHandle_t task = new StubTask();
+    task->priority = priority;
+    if (handle)
+    {
+        *handle = task;
+    }
+    std::thread([=]() {
+        stubCurrentTask() = task;
+        function(parameter);
+    }).detach();
+    return pdPASS;
+}
+
+// A host thread cannot be stopped from outside: the stubs of the tasks end on their own
+inline void vTaskDelete(TaskHandle_t) {}
+inline void vTaskSuspend(TaskHandle_t) {}
+
+inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+    stubMicros += (int64_t)ticks * 1000;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifications++;
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken)
+    {
+        *woken = pdFALSE;
+    }
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    TaskHandle_t task = stubCurrentTask();
+    std::unique_lock<std::mutex> lock(task->lock);
+    stubWait(task->cv, lock, ticks, [=] { return task->notifications > 0; });
+    uint32_t value = task->notifications;
+    if (value)
+    {
+        task->notifications = clear ? 0 : value - 1;
+    }
+    return value;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef STUB_MAIN_GLOBALS_H
+#define STUB_MAIN_GLOBALS_H
+
+// Globals defined by main.cpp and config.cpp, with the same initial values.
+// Include it in one file of each test.
+
+#include "global_vars.h"
+#include "LogFloor.h"
+#include "telemetry.h"
+
+RTC_DATA_ATTR uint8_t  channel;
+RTC_DATA_ATTR uint8_t  bssid[6];
+RTC_DATA_ATTR uint8_t  failedConnection;
+RTC_DATA_ATTR uint16_t lastMeasure[PROBE_COUNT];
+RTC_DATA_ATTR uint8_t  logLevel = LOG_LEVEL_NOTICE;
+RTC_DATA_ATTR uint8_t  logLevelSerial = LOG_LEVEL_VERBOSE;
+RTC_DATA_ATTR uint8_t  logLevelFile = LOG_LEVEL_VERBOSE;
+RTC_DATA_ATTR uint8_t  logLevelMqtt = LOG_LEVEL_VERBOSE;
+RTC_DATA_ATTR bool     rtcValid = false;
+RTC_DATA_ATTR uint32_t run = 0;
+
+WiFiClient   espClient;
+PubSubClient client(espClient);
+
+bool callback_running = false;
+
+float                  batteryLevel = 0;
+RTC_DATA_ATTR uint64_t sleepTime = DEFAULT_SLEEP_TIME;
+RTC_DATA_ATTR uint64_t sleepTimeOnPower = DEFAULT_SLEEP_TIME;
+RTC_DATA_ATTR float    onPowerThreshold = BATTERY_ON_POWER_THRESHOLD;
+RTC_DATA_ATTR int      minLevel[PROBE_COUNT];
+RTC_DATA_ATTR int      maxLevel[PROBE_COUNT];
+RTC_DATA_ATTR uint8_t  maxDifference;
+RTC_DATA_ATTR bool     batteryAlertSent = false;
+RTC_DATA_ATTR bool     waterLevelAlertSent = false;
+RTC_DATA_ATTR int8_t   temperature = DEFAULT_TEMPERATURE;
+RTC_DATA_ATTR uint8_t  burstSize = DEFAULT_BURST_SIZE;
+RTC_DATA_ATTR uint8_t  burstThreshold = DEFAULT_BURST_THRESHOLD;
+RTC_DATA_ATTR uint8_t  batchSize = DEFAULT_BATCH_SIZE;
+RTC_DATA_ATTR uint8_t  batchDepth = DEFAULT_BATCH_DEPTH;
+RTC_DATA_ATTR uint8_t  profileInterval = DEFAULT_PROFILE_INTERVAL;
+RTC_DATA_ATTR uint16_t reportDelta = DEFAULT_REPORT_DELTA;
+RTC_DATA_ATTR uint16_t heartbeatInterval = DEFAULT_HEARTBEAT_INTERVAL;
+RTC_DATA_ATTR uint8_t  telemetryFormat = TELEMETRY_TOPICS;
+RTC_DATA_ATTR uint8_t  persistentSession = 0;
+RTC_DATA_ATTR bool     sessionSubscribed = false;
+RTC_DATA_ATTR uint16_t drainTimeout = DEFAULT_DRAIN_TIMEOUT;
+
+long    waterLevel[PROBE_COUNT];
+uint8_t waterConfidence[PROBE_COUNT];
+long    wifiStart = 0;
+
+String WLAN_SSID   = "wifiSSID";
+String WLAN_PASSWD = "PassW0rd";
+
+IPAddress staticIP = IPAddress(192, 168, 0, 200);
+IPAddress gateway  = IPAddress(192, 168, 0, 1);
+IPAddress subnet   = IPAddress(255, 255, 255, 0);
+IPAddress dns      = IPAddress(192, 168, 0, 1);
+
+IPAddress MQTT_SERVER = IPAddress(192, 168, 0, 201);
+String    ROOT_TOPIC  = "water";
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef STUB_SOC_H
+#define STUB_SOC_H
+
+#include <cstdint>
+
+// The string literals of a position dependent host executable are below the
+// end of its initialised data, and at the same address in the ELF file
+extern "C" char edata;
+
+#define SOC_DROM_LOW 0
+#define SOC_DROM_HIGH ((uintptr_t)&edata)
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef STUB_CLOCK_H
+#define STUB_CLOCK_H
+
+#include <atomic>
+#include <cstdint>
+
+// Simulated time since the boot, in us. It only moves with delay(),
+// delayMicroseconds() and vTaskDelay(), so the tests do not depend on the host.
+inline std::atomic<int64_t> stubMicros{0};
+
+#endif
@@ -0,0 +1,106 @@
+#include <unity.h>
+#include "Arduino.h"
+#include "ArenaAllocator.h"
+
+#define ARENA_SIZE 256
+
+static ArenaAllocator<ARENA_SIZE> arena;
+
+void setUp()
+{
+    arena.reset();
+}
+
+void tearDown() {}
+
+void test_blocks_aligned_and_bounded()
+{
+    uint8_t *first = (uint8_t *)arena.allocate(3);
+    uint8_t *second = (uint8_t *)arena.allocate(20);
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_NOT_NULL(second);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)first % 8);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)second % 8);
+    TEST_ASSERT_GREATER_OR_EQUAL(first + 8, second);
+
+    // No room left: nothing is allocated
+    size_t used = arena.peak();
+    TEST_ASSERT_NULL(arena.allocate(ARENA_SIZE));
+    TEST_ASSERT_EQUAL(used, arena.peak());
+
+    arena.reset();
+    TEST_ASSERT_EQUAL(0, arena.peak());
+    TEST_ASSERT_EQUAL_PTR(first, arena.allocate(3));
+}
+
+void test_last_block_resized_in_place()
+{
+    uint8_t *block = (uint8_t *)arena.allocate(16);
+    memset(block, 'a', 16);
+    TEST_ASSERT_EQUAL_PTR(block, arena.reallocate(block, 64));
+    TEST_ASSERT_EQUAL_PTR(block, arena.reallocate(block, 8));
+    TEST_ASSERT_EQUAL('a', block[7]);
+
+    // The space given back is used by the next block
+    uint8_t *next = (uint8_t *)arena.allocate(8);
+    TEST_ASSERT_LESS_THAN(block + 64, next);
+}
+
+void test_moved_block_copies_its_own_bytes()
+{
+    uint8_t *first = (uint8_t *)arena.allocate(16);
+    uint8_t *second = (uint8_t *)arena.allocate(64);
+    memset(first, 'a', 16);
+    memset(second, 'b', 64);
+
+    // Only the 16 bytes of the block, not the block after it
+    uint8_t *moved = (uint8_t *)arena.reallocate(first, 64);
+    TEST_ASSERT_NOT_NULL(moved);
+    TEST_ASSERT_NOT_EQUAL(first, moved);
+    for (int i = 0; i < 16; i++)
+    {
+        TEST_ASSERT_EQUAL('a', moved[i]);
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        TEST_ASSERT_NOT_EQUAL('b', moved[i]);
+    }
+    for (int i = 0; i < 64; i++)
+    {
+        TEST_ASSERT_EQUAL('b', second[i]);
+    }
+}
+
+void test_block_shrunk_in_place()
+{
+    uint8_t *first = (uint8_t *)arena.allocate(64);
+    arena.allocate(8);
+    size_t used = arena.peak();
+
+    // Shrunk, then grown back within its size: it stays where it is
+    TEST_ASSERT_EQUAL_PTR(first, arena.reallocate(first, 16));
+    TEST_ASSERT_EQUAL_PTR(first, arena.reallocate(first, 64));
+    TEST_ASSERT_EQUAL(used, arena.peak());
+}
+
+void test_block_not_moved_without_room()
+{
+    // The block keeps its place and its bytes when the arena is full
+    uint8_t *first = (uint8_t *)arena.allocate(ARENA_SIZE / 2);
+    arena.allocate(ARENA_SIZE / 4);
+    memset(first, 'a', ARENA_SIZE / 2);
+    TEST_ASSERT_NULL(arena.reallocate(first, ARENA_SIZE / 2 + 8));
+    TEST_ASSERT_EQUAL('a', first[ARENA_SIZE / 2 - 1]);
+    TEST_ASSERT_NOT_NULL(arena.reallocate(nullptr, 8));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_blocks_aligned_and_bounded);
+    RUN_TEST(test_last_block_resized_in_place);
+    RUN_TEST(test_moved_block_copies_its_own_bytes);
+    RUN_TEST(test_block_shrunk_in_place);
+    RUN_TEST(test_block_not_moved_without_room);
+    return UNITY_END();
+}
@@ -0,0 +1,218 @@
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "main_globals.h"
+#include "batch.cpp"
+#include "topics.cpp"
+
+// Readings of the batch messages, in the order they were published
+struct Sent {
+    uint8_t  probe;
+    uint16_t distance;
+};
+
+static std::vector<Sent> sent;
+static std::vector<unsigned> dropped;   // header of each message
+
+static void collect()
+{
+    for (const std::string &payload : client.payloads(getTopic(TOPIC_BATCH)))
+    {
+        unsigned long time;
+        unsigned count, lost;
+        const char *line = payload.c_str();
+        TEST_ASSERT_EQUAL(3, sscanf(line, "%lu,%u,%u", &time, &count, &lost));
+        dropped.push_back(lost);
+
+        for (unsigned i = 0; i < count; i++)
+        {
+            line = strchr(line, '\n') + 1;
+            unsigned long timestamp;
+            unsigned probe, distance, status;
+            TEST_ASSERT_EQUAL(4, sscanf(line, "%lu,%u,%u,%u", &timestamp, &probe, &distance, &status));
+            TEST_ASSERT_EQUAL(READING_OK, status);
+            sent.push_back({(uint8_t)probe, (uint16_t)distance});
+        }
+        TEST_ASSERT_EQUAL(0, strcmp(strchr(line, '\n'), "\n"));
+    }
+    client.messages.clear();
+}
+
+// One wake as in setup(): is the batch due, measure, report if due and connected,
+// then deep sleep. Only the RTC variables are kept between 2 calls.
+static uint16_t nextDistance = 1000;
+
+static void wake()
+{
+    bool due = batchDue(false);
+    long levels[PROBE_COUNT];
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
+    {
+        levels[i] = nextDistance++;
+        batchAdd(i, levels[i]);
+    }
+    if (!due && levelsChanged(levels, 3.3))
+    {
+        due = true;
+    }
+    if (due && client.connected() && batchPublish())
+    {
+        batchReported(levels, 3.3);
+    }
+    collect();
+}
+
+void setUp()
+{
+    readingHead = 0;
+    readingCount = 0;
+    readingDropped = 0;
+    wakesSinceReport = 0;
+    batchSize = 4;
+    batchDepth = DEFAULT_BATCH_DEPTH;
+    reportDelta = 0;
+    heartbeatInterval = DEFAULT_HEARTBEAT_INTERVAL;
+    memset(lastSentLevel, 0, sizeof(lastSentLevel));
+    lastSentVoltage = 0;
+    rtcValid = true;
+    client.online = true;
+    client.messages.clear();
+    sent.clear();
+    dropped.clear();
+    nextDistance = 1000;
+    initTopics();
+}
+
+void tearDown() {}
+
+static void checkInOrder(uint16_t first, size_t count)
+{
+    TEST_ASSERT_EQUAL(count, sent.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        TEST_ASSERT_EQUAL(first + i, sent[i].distance);
+        TEST_ASSERT_EQUAL((first + i - 1000) % PROBE_COUNT, sent[i].probe);
+    }
+}
+
+void test_readings_sent_in_order_across_sleeps()
+{
+    // Enough wakes for the head to go round the ring several times
+    for (int i = 0; i < 200; i++)
+    {
+        wake();
+    }
+
+    TEST_ASSERT_EQUAL(200 % batchSize * PROBE_COUNT, batchCount());
+    checkInOrder(1000, 200 * PROBE_COUNT - batchCount());
+    TEST_ASSERT_EQUAL(200 / batchSize, dropped.size());
+    TEST_ASSERT_EQUAL(0, dropped.back());
+}
+
+void test_readings_kept_while_publish_fails()
+{
+    for (int i = 0; i < 4; i++)
+    {
+        wake();
+    }
+    client.online = false;
+    for (int i = 0; i < 9; i++)
+    {
+        wake();
+    }
+    TEST_ASSERT_EQUAL(9 * PROBE_COUNT, batchCount());
+
+    // The first connected wake sends the whole backlog
+    client.online = true;
+    wake();
+
+    TEST_ASSERT_EQUAL(0, batchCount());
+    checkInOrder(1000, 14 * PROBE_COUNT);
+}
+
+void test_backlog_sent_without_batching()
+{
+    // Each wake reports its own readings on the level topics
+    batchSize = 1;
+    wake();
+    TEST_ASSERT_EQUAL(0, sent.size());
+    TEST_ASSERT_EQUAL(0, batchCount());
+
+    // The readings of the wakes that could not report are sent as a batch
+    client.online = false;
+    for (int i = 0; i < 5; i++)
+    {
+        wake();
+    }
+    TEST_ASSERT_EQUAL(5 * PROBE_COUNT, batchCount());
+
+    client.online = true;
+    wake();
+    TEST_ASSERT_EQUAL(0, batchCount());
+    checkInOrder(1000 + PROBE_COUNT, 6 * PROBE_COUNT);
+}
+
+void test_full_buffer_drops_the_oldest()
+{
+    batchDepth = 3 * PROBE_COUNT;
+    client.online = false;
+    for (int i = 0; i < 10; i++)
+    {
+        wake();
+    }
+    TEST_ASSERT_EQUAL(batchDepth, batchCount());
+    TEST_ASSERT_EQUAL(7 * PROBE_COUNT, readingDropped);
+
+    client.online = true;
+    for (int i = 0; i < 4; i++)
+    {
+        wake();
+    }
+
+    // The buffer is still full on the first connected wake: the last 2 offline
+    // wakes are sent with it, then the next wakes
+    TEST_ASSERT_EQUAL(0, batchCount());
+    checkInOrder(1000 + 8 * PROBE_COUNT, 6 * PROBE_COUNT);
+    TEST_ASSERT_EQUAL(2, dropped.size());
+    TEST_ASSERT_EQUAL(8 * PROBE_COUNT, dropped[0]);
+    TEST_ASSERT_EQUAL(0, dropped[1]);
+}
+
+void test_quiet_wakes_sent_before_the_buffer_is_full()
+{
+    // Report by exception without batching: the levels hardly move, the
+    // heartbeat is far away
+    batchSize = 1;
+    reportDelta = 1000;
+    heartbeatInterval = 1000;
+
+    // The first wake reports on the level topics
+    wake();
+    TEST_ASSERT_EQUAL(0, sent.size());
+
+    for (int i = 1; i < 100; i++)
+    {
+        wake();
+    }
+
+    // The readings of the quiet wakes are sent each time the buffer nears full,
+    // none is lost
+    TEST_ASSERT_GREATER_THAN(1, dropped.size());
+    for (unsigned lost : dropped)
+    {
+        TEST_ASSERT_EQUAL(0, lost);
+    }
+    TEST_ASSERT_EQUAL(0, readingDropped);
+    checkInOrder(1000 + PROBE_COUNT, 99 * PROBE_COUNT - batchCount());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_readings_sent_in_order_across_sleeps);
+    RUN_TEST(test_readings_kept_while_publish_fails);
+    RUN_TEST(test_backlog_sent_without_batching);
+    RUN_TEST(test_full_buffer_drops_the_oldest);
+    RUN_TEST(test_quiet_wakes_sent_before_the_buffer_is_full);
+    return UNITY_END();
+}
@@ -0,0 +1,160 @@
+#define LOG_FORMAT_BINARY 1
+
+#include <unity.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include "main_globals.h"
+#include "BinaryLog.cpp"
+#include "MultiPrint.cpp"
+#include "PrintUtils.cpp"
+
+// Keeps what the log output received
+class Capture : public Print
+{
+    public:
+        std::string text;
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *buffer, size_t size) override
+        {
+            text.append((const char *)buffer, size);
+            return size;
+        }
+};
+
+class Address : public Printable
+{
+    public:
+        size_t printTo(Print &p) const override { return p.print("192.168.1.7"); }
+};
+
+enum Side { SIDE_LEFT, SIDE_RIGHT };
+
+static Capture output;
+
+void setUp()
+{
+    output.text.clear();
+    Log.begin(LOG_LEVEL_TRACE, &output);
+}
+
+void tearDown() {}
+
+// The record of a frame, unescaped
+static std::string unescape(const std::string &frame)
+{
+    std::string record;
+    for (size_t i = 1; i < frame.size() - 1; i++)
+    {
+        record += frame[i] == BINARY_LOG_ESCAPE ? (char)(frame[++i] ^ 0x20) : frame[i];
+    }
+    return record;
+}
+
+void test_record_in_a_frame()
+{
+    static const char format[] = "Distance %d: %d mm";
+    Log.noticeln(format, 1, -3);
+
+    // Level, address of the format, time delta, then the tagged arguments
+    std::string frame = output.text;
+    TEST_ASSERT_EQUAL(0, frame.front());
+    TEST_ASSERT_EQUAL('\n', frame.back());
+    std::string record = unescape(frame);
+    uint32_t id = (uint32_t)(uintptr_t)format;
+    std::string expected = {(char)LOG_LEVEL_NOTICE, (char)id, (char)(id >> 8), (char)(id >> 16), (char)(id >> 24),
+                            0, BINARY_LOG_SIGNED, 2, BINARY_LOG_SIGNED, 5};
+    TEST_ASSERT_EQUAL(expected.size(), record.size());
+    TEST_ASSERT_EQUAL(0, expected.compare(record));
+}
+
+void test_frame_escapes_the_reserved_bytes()
+{
+    // The time delta and the high byte of the format address are 0 too
+    Log.noticeln(F("%s"), "a\nb\x1b" "c");
+
+    // One frame on one line: 0 only at the start, '\n' only at the end
+    std::string frame = output.text;
+    TEST_ASSERT_EQUAL(0, frame.front());
+    TEST_ASSERT_EQUAL(std::string::npos, frame.find('\0', 1));
+    TEST_ASSERT_EQUAL(frame.size() - 1, frame.find('\n'));
+
+    std::string record = unescape(frame);
+    std::string argument = {BINARY_LOG_STRING, 5, 'a', '\n', 'b', BINARY_LOG_ESCAPE, 'c'};
+    TEST_ASSERT_EQUAL(0, record.compare(record.size() - argument.size(), argument.size(), argument));
+}
+
+void test_levels_above_the_logger_not_sent()
+{
+    Log.verboseln(F("verbose %d"), 1);
+    TEST_ASSERT_EQUAL(0, output.text.size());
+}
+
+// Runs tools/logdecode.py on the log with this executable as firmware ELF
+static std::string decode(const std::string &log)
+{
+    char exe[512];
+    ssize_t length = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    TEST_ASSERT_GREATER_THAN(0, length);
+    exe[length] = 0;
+
+    std::string path = std::string(exe) + ".log";
+    std::ofstream(path, std::ios::binary) << log;
+
+    std::string source = __FILE__;
+    std::string tools = source.substr(0, source.find_last_of("/\\") + 1) + "../../tools/";
+    std::string command = "python3 " + tools + "logdecode.py " + exe + " " + path + " 2>&1";
+
+    std::string text;
+    FILE *pipe = popen(command.c_str(), "r");
+    TEST_ASSERT_NOT_NULL(pipe);
+    char buffer[256];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+    {
+        text.append(buffer, read);
+    }
+    int status = pclose(pipe);
+    remove(path.c_str());
+    if (status != 0)
+    {
+        TEST_IGNORE_MESSAGE(("logdecode.py not run: " + text).c_str());
+    }
+    return text;
+}
+
+void test_decoder_rebuilds_the_text()
+{
+    char stackFormat[16];
+    strcpy(stackFormat, "stack %d");
+
+    binaryLogWake(1234);
+    Log.noticeln(F("Sleep time %i s, %l, %u"), -42, 100000L, 4000000000UL);
+    Log.traceln("Voltage %F V, %D, hex %x %X bin %B", 3.71f, -2.5, 255, 16, 5);
+    Log.warningln(F("bool %T %t char %c str %s %s ip %p enum %d"), true, false, 'Z', "lit", String("heap"), Address(), SIDE_RIGHT);
+    Log.errorln(stackFormat, 7);
+    Log.noticeln(F("long %s end %d"), std::string(300, 'x').c_str(), 1);
+    Log.noticeln(F("no args %% done"));
+    output.print("I (123) wifi: text line\n");
+
+    TEST_ASSERT_EQUAL_STRING("01234-00.000 Sleep time -42 s, 100000, 4000000000\n"
+                             "01234-00.000 Voltage 3.71 V, -2.50, hex FF 0x10 bin 0b101\n"
+                             "01234-00.000 bool true F char Z str lit heap ip 192.168.1.7 enum 1\n"
+                             "01234-00.000 stack 7\n"
+                             "01234-00.000 long ? end ?\n"
+                             "01234-00.000 no args % done\n"
+                             "I (123) wifi: text line\n",
+                             decode(output.text).c_str());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_record_in_a_frame);
+    RUN_TEST(test_frame_escapes_the_reserved_bytes);
+    RUN_TEST(test_levels_above_the_logger_not_sent);
+    RUN_TEST(test_decoder_rebuilds_the_text);
+    return UNITY_END();
+}
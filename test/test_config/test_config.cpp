@@ -0,0 +1,237 @@
+// Pools of the same size in bytes as on the 32 bits target, where the slots are half as big
+#define ARDUINOJSON_POOL_CAPACITY 64
+
+#include <unity.h>
+#include <random>
+#include <string>
+#include "main_globals.h"
+#include "configure.cpp"
+#include "settings.cpp"
+#include "topics.cpp"
+
+// The binary log is not under test
+void binaryLogBegin(Print *output) {}
+
+// Discards the log
+class NullPrint : public Print
+{
+    public:
+        size_t write(uint8_t c) override { return 1; }
+};
+
+static NullPrint output;
+
+// Copy of all the settings, to see what a message changed
+struct Snapshot {
+    uint32_t crc;
+    uint64_t dirty;
+
+    bool operator==(const Snapshot &other) const { return crc == other.crc && dirty == other.dirty; }
+};
+
+static Snapshot snapshot()
+{
+    return {settingsCrcOf(), settingsDirty};
+}
+
+void setUp()
+{
+    Preferences::erase();
+    Preferences preferences;
+    preferences.begin(SETTINGS_NAMESPACE);
+    run = 0;
+    loadSettings(preferences);
+    settingsDirty = 0;
+}
+
+void tearDown() {}
+
+static int parse(const std::string &message)
+{
+    int changed = configParse(message.data(), message.size());
+    TEST_ASSERT_LESS_OR_EQUAL(CONFIG_ARENA_SIZE, configAllocator.peak());
+    return changed;
+}
+
+// Every setting in its range, in the unit of the variable
+static void checkRanges()
+{
+    for (uint8_t i = 0; i < SETTING_TABLE_SIZE; i++)
+    {
+        const SettingInfo &info = SETTING_TABLE[i];
+        for (uint8_t index = 0; index < valueCount(info); index++)
+        {
+            double low = info.min * info.scale;
+            double high = info.max * info.scale;
+            double margin = 1e-6 * std::max(fabs(low), fabs(high));
+            double raw = getRaw(info, index);
+            TEST_ASSERT_TRUE_MESSAGE(raw >= low - margin && raw <= high + margin, info.name);
+        }
+    }
+}
+
+void test_valid_config_applied()
+{
+    TEST_ASSERT_EQUAL(3, parse("{\"burstSize\":9,\"maxLevel[1]\":450,\"sleepTime\":60}"));
+    TEST_ASSERT_EQUAL(9, burstSize);
+    TEST_ASSERT_EQUAL(450, maxLevel[1]);
+    TEST_ASSERT_EQUAL(60000000, sleepTime);
+}
+
+void test_malformed_config_changes_nothing()
+{
+    const char *const messages[] = {
+        "",
+        "{",
+        "{\"burstSize\":9",
+        "{\"burstSize\":9,",
+        "{\"burstSize\":}",
+        "{\"burstSize\" 9}",
+        "{\"burstSize\":9,\"batchSize\":",
+        "{\"burstSize\":9,\"batchSize\":\"5}",
+        "{\"burstSize\":-}",
+        "\xff\xfe{}",
+    };
+
+    Snapshot before = snapshot();
+    for (const char *message : messages)
+    {
+        TEST_ASSERT_EQUAL_MESSAGE(-1, parse(message), message);
+        TEST_ASSERT_TRUE_MESSAGE(before == snapshot(), message);
+    }
+}
+
+void test_rejected_values_change_nothing()
+{
+    // Valid JSON, but no setting can take these values
+    const char *const messages[] = {
+        "[9]",
+        "9",
+        "null",
+        "{}",
+        "{\"unknown\":9}",
+        "{\"burstSize\":\"9\"}",
+        "{\"burstSize\":true}",
+        "{\"burstSize\":null}",
+        "{\"burstSize\":[9]}",
+        "{\"burstSize\":{\"value\":9}}",
+        "{\"burstSize\":0}",
+        "{\"burstSize\":-1}",
+        "{\"burstSize\":1e300}",
+        "{\"batchSize\":256}",
+        "{\"temperature\":200}",
+        "{\"telemetryFormat\":3}",
+        "{\"drainTimeout\":5}",
+        "{\"minLevel[2]\":500}",
+        "{\"minLevel[9]\":500}",
+        "{\"minLevel[]\":500}",
+        "{\"sleepTime[1]\":500}",
+    };
+
+    Snapshot before = snapshot();
+    for (const char *message : messages)
+    {
+        TEST_ASSERT_EQUAL_MESSAGE(0, parse(message), message);
+        TEST_ASSERT_TRUE_MESSAGE(before == snapshot(), message);
+    }
+}
+
+void test_rejected_value_does_not_stop_the_others()
+{
+    TEST_ASSERT_EQUAL(1, parse("{\"burstSize\":0,\"batchSize\":5,\"unknown\":1}"));
+    TEST_ASSERT_EQUAL(DEFAULT_BURST_SIZE, burstSize);
+    TEST_ASSERT_EQUAL(5, batchSize);
+}
+
+void test_oversized_config_changes_nothing()
+{
+    Snapshot before = snapshot();
+
+    // More members than the arena holds, the valid one first
+    std::string members = "{\"burstSize\":9";
+    for (int i = 0; members.size() < 4 * CONFIG_ARENA_SIZE; i++)
+    {
+        members += ",\"key" + std::to_string(i) + "\":" + std::to_string(i);
+    }
+    members += "}";
+    TEST_ASSERT_EQUAL(-1, parse(members));
+    TEST_ASSERT_TRUE(before == snapshot());
+
+    // A key longer than the arena
+    TEST_ASSERT_EQUAL(-1, parse("{\"burstSize\":9,\"" + std::string(2 * CONFIG_ARENA_SIZE, 'k') + "\":1}"));
+    TEST_ASSERT_TRUE(before == snapshot());
+
+    // Nested deeper than the parser accepts
+    TEST_ASSERT_EQUAL(-1, parse("{\"burstSize\":9,\"a\":" + std::string(200, '[') + std::string(200, ']') + "}"));
+    TEST_ASSERT_TRUE(before == snapshot());
+
+    // The arena is reset for each message
+    TEST_ASSERT_EQUAL(1, parse("{\"burstSize\":9}"));
+    TEST_ASSERT_EQUAL(9, burstSize);
+}
+
+/********\
+ * Fuzz *
+\********/
+
+#define FUZZ_MESSAGES 20000
+
+// Bytes that break or reshape a JSON message
+static const char FUZZ_BYTES[] = "{}[]\":,-.0123456789eE \\nt";
+
+void test_fuzzed_configs_stay_in_range()
+{
+    const std::string valid = "{\"minLevel[0]\":1800,\"maxLevel[1]\":450,\"sleepTime\":60,\"onPowerThreshold\":3.9,"
+                              "\"burstSize\":9,\"batchDepth\":20,\"temperature\":-5,\"logLevel\":4}";
+    std::mt19937 generator(42);
+    int accepted = 0;
+
+    for (int i = 0; i < FUZZ_MESSAGES; i++)
+    {
+        std::string message = valid;
+        int mutations = 1 + generator() % 4;
+        for (int m = 0; m < mutations && !message.empty(); m++)
+        {
+            size_t at = generator() % message.size();
+            char byte = generator() % 3 == 0 ? (char)(generator() % 256) : FUZZ_BYTES[generator() % (sizeof(FUZZ_BYTES) - 1)];
+            switch (generator() % 4)
+            {
+            case 0: message[at] = byte; break;
+            case 1: message.insert(at, 1, byte); break;
+            case 2: message.erase(at, 1 + generator() % 8); break;
+            case 3: message.insert(at, message.substr(generator() % message.size(), generator() % 64)); break;
+            }
+        }
+
+        Snapshot before = snapshot();
+        int changed = parse(message);
+        if (changed < 0)
+        {
+            TEST_ASSERT_TRUE_MESSAGE(before == snapshot(), message.c_str());
+        }
+        else
+        {
+            accepted++;
+        }
+        checkRanges();
+    }
+
+    char text[64];
+    snprintf(text, sizeof(text), "%d of %d fuzzed messages parsed", accepted, FUZZ_MESSAGES);
+    TEST_MESSAGE(text);
+}
+
+int main(int argc, char **argv)
+{
+    // The fuzzed messages change the log level too
+    Log.begin(LOG_LEVEL_SILENT, &output);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_valid_config_applied);
+    RUN_TEST(test_malformed_config_changes_nothing);
+    RUN_TEST(test_rejected_values_change_nothing);
+    RUN_TEST(test_rejected_value_does_not_stop_the_others);
+    RUN_TEST(test_oversized_config_changes_nothing);
+    RUN_TEST(test_fuzzed_configs_stay_in_range);
+    return UNITY_END();
+}
@@ -0,0 +1,211 @@
+#define BASE_PATH "/tmp/waterlevel_test_file_print"    // LittleFS of the tests
+
+#include <unity.h>
+#include <chrono>
+#include <dirent.h>
+#include <string>
+#include "main_globals.h"
+#include "FilePrint.cpp"
+#include "files.cpp"
+#include "topics.cpp"
+
+// The binary log is not under test
+void binaryLogBegin(Print *output) {}
+
+// Discards the log
+class NullPrint : public Print
+{
+    public:
+        size_t write(uint8_t c) override { return 1; }
+};
+
+static NullPrint output;
+
+// Empties the partition
+static void format()
+{
+    DIR *dir = opendir(BASE_PATH);
+    if (dir == NULL)
+    {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            remove((std::string(BASE_PATH "/") + entry->d_name).c_str());
+        }
+    }
+    closedir(dir);
+}
+
+static void writeFile(const char *name, const char *content)
+{
+    File file = LittleFS.open(name, "w");
+    TEST_ASSERT_TRUE((bool)file);
+    file.print(content);
+    file.close();
+}
+
+static std::string readFile(const char *name)
+{
+    File file = LittleFS.open(name, "r");
+    if (!file)
+    {
+        return "";
+    }
+    char buffer[64];
+    size_t length = file.readBytes(buffer, sizeof(buffer));
+    return std::string(buffer, length);
+}
+
+// The "." and ".." of the computer are not in LittleFS
+static int fileCount()
+{
+    int count = 0;
+    listDir("/", [](const FileEntry &entry, void *context) {
+        *(int *)context += entry.name[0] != '.';
+        return true;
+    }, &count);
+    return count;
+}
+
+// One wake: the log is opened in setup(), closed before the deep sleep
+static String boot()
+{
+    FilePrint log;
+    TEST_ASSERT_TRUE(log.begin());
+    log.println("A log line");
+    log.close();
+    return log.getLastLogFileName();
+}
+
+void setUp()
+{
+    LittleFS.begin(false, BASE_PATH);
+    format();
+}
+
+void tearDown() {}
+
+void test_index_bumped_once_per_wake()
+{
+    // Built but not started: nothing is touched
+    {
+        FilePrint unused;
+    }
+    TEST_ASSERT_FALSE(LittleFS.exists(LOG_INDEX_FILE));
+
+    FilePrint log;
+    FilePrint other;
+    TEST_ASSERT_TRUE(log.begin());
+    TEST_ASSERT_TRUE(log.begin());
+    TEST_ASSERT_EQUAL_STRING("0\r\n", readFile(LOG_INDEX_FILE).c_str());
+    TEST_ASSERT_EQUAL_STRING("", log.getLastLogFileName().c_str());
+    log.close();
+
+    // The next wake names the slot written by this one
+    TEST_ASSERT_EQUAL_STRING("/log000.txt", boot().c_str());
+    TEST_ASSERT_EQUAL_STRING("1\r\n", readFile(LOG_INDEX_FILE).c_str());
+    TEST_ASSERT_EQUAL(0, readFile("/log000.txt").find("# Log File"));
+}
+
+void test_slots_written_round_robin()
+{
+    for (int i = 0; i < MAX_LOG_FILE_NUMBER + 5; i++)
+    {
+        boot();
+    }
+
+    // The slots and the index, the oldest slot written over
+    TEST_ASSERT_EQUAL_STRING("/log004.txt", boot().c_str());
+    TEST_ASSERT_EQUAL(MAX_LOG_FILE_NUMBER + 1, fileCount());
+    TEST_ASSERT_EQUAL_STRING("25\r\n", readFile(LOG_INDEX_FILE).c_str());
+}
+
+void test_legacy_files_scanned_without_index()
+{
+    // Written by a firmware without index: the highest number is the newest
+    char name[FILE_NAME_MAX_LENGTH];
+    for (int i = 0; i < 8; i++)
+    {
+        snprintf(name, sizeof(name), "/log%03d.txt", i);
+        writeFile(name, "# Log File\n");
+    }
+    writeFile("/log008.txt", "");
+    writeFile("/log025.txt", "# Log File\n");
+    writeFile("/notes.txt", "kept");
+
+    TEST_ASSERT_EQUAL_STRING("/log007.txt", boot().c_str());
+    TEST_ASSERT_EQUAL_STRING("8\r\n", readFile(LOG_INDEX_FILE).c_str());
+    TEST_ASSERT_FALSE(LittleFS.exists("/log025.txt"));
+    TEST_ASSERT_TRUE(LittleFS.exists("/notes.txt"));
+    TEST_ASSERT_NOT_EQUAL(0, readFile("/log008.txt").size());
+}
+
+void test_corrupted_index_falls_back_to_the_scan()
+{
+    boot();
+    boot();
+    writeFile(LOG_INDEX_FILE, "garbage");
+    TEST_ASSERT_EQUAL_STRING("/log001.txt", boot().c_str());
+    TEST_ASSERT_EQUAL_STRING("2\r\n", readFile(LOG_INDEX_FILE).c_str());
+}
+
+/*************\
+ * Benchmark *
+\*************/
+
+#define BENCHMARK_BOOTS 200
+
+// Time from the mount to the log file ready, with a full set of slots
+static double mountToReady(bool withIndex)
+{
+    std::chrono::duration<double, std::micro> elapsed(0);
+    for (int i = 0; i < BENCHMARK_BOOTS; i++)
+    {
+        if (!withIndex)
+        {
+            LittleFS.remove(LOG_INDEX_FILE);
+        }
+        LittleFS.end();
+
+        FilePrint log;
+        auto start = std::chrono::steady_clock::now();
+        TEST_ASSERT_TRUE(log.begin());
+        elapsed += std::chrono::steady_clock::now() - start;
+        log.close();
+    }
+    return elapsed.count() / BENCHMARK_BOOTS;
+}
+
+void test_mount_to_ready_time()
+{
+    for (int i = 0; i < MAX_LOG_FILE_NUMBER; i++)
+    {
+        boot();
+    }
+
+    double indexed = mountToReady(true);
+    double scanned = mountToReady(false);
+
+    char message[96];
+    snprintf(message, sizeof(message), "%d slots: %.0f us from the index, %.0f us scanning the directory",
+             MAX_LOG_FILE_NUMBER, indexed, scanned);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    Log.begin(LOG_LEVEL_SILENT, &output);
+    initTopics();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_index_bumped_once_per_wake);
+    RUN_TEST(test_slots_written_round_robin);
+    RUN_TEST(test_legacy_files_scanned_without_index);
+    RUN_TEST(test_corrupted_index_falls_back_to_the_scan);
+    RUN_TEST(test_mount_to_ready_time);
+    return UNITY_END();
+}
@@ -0,0 +1,227 @@
+#include <unity.h>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+#include "main_globals.h"
+#include "files.cpp"
+#include "topics.cpp"
+
+// Heap allocations made by the code under test
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *block = malloc(size);
+    if (block == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void operator delete(void *block) noexcept { free(block); }
+void operator delete(void *block, size_t) noexcept { free(block); }
+
+void setUp() {}
+void tearDown() {}
+
+// The requests arrive in the MQTT buffer without a terminating 0
+static bool parse(const char *request, FileRequest &parsed)
+{
+    char payload[64];
+    size_t length = strlen(request);
+    memcpy(payload, request, length);
+    payload[length] = '#';
+    return parseFileRequest(payload, length, parsed);
+}
+
+void test_request_with_name_only()
+{
+    FileRequest parsed;
+    TEST_ASSERT_TRUE(parse("/log.3", parsed));
+    TEST_ASSERT_EQUAL_STRING("/log.3", parsed.name);
+    TEST_ASSERT_EQUAL(0, parsed.offset);
+    TEST_ASSERT_EQUAL(UINT32_MAX, parsed.length);
+}
+
+void test_request_with_range()
+{
+    FileRequest parsed;
+    TEST_ASSERT_TRUE(parse("/log.3,2048", parsed));
+    TEST_ASSERT_EQUAL_STRING("/log.3", parsed.name);
+    TEST_ASSERT_EQUAL(2048, parsed.offset);
+    TEST_ASSERT_EQUAL(UINT32_MAX, parsed.length);
+
+    TEST_ASSERT_TRUE(parse("/log.3,2048,4294967295", parsed));
+    TEST_ASSERT_EQUAL(2048, parsed.offset);
+    TEST_ASSERT_EQUAL(UINT32_MAX, parsed.length);
+
+    TEST_ASSERT_TRUE(parse("/log.3,0,100", parsed));
+    TEST_ASSERT_EQUAL(0, parsed.offset);
+    TEST_ASSERT_EQUAL(100, parsed.length);
+}
+
+void test_invalid_requests()
+{
+    FileRequest parsed;
+    TEST_ASSERT_FALSE(parse("", parsed));
+    TEST_ASSERT_FALSE(parse(",100", parsed));
+    TEST_ASSERT_FALSE(parse("/a_name_that_does_not_fit_in_32_bytes", parsed));
+    TEST_ASSERT_FALSE(parse("/log.3,1234567890,1234567890,1234", parsed));
+
+    // The longest name that fits
+    TEST_ASSERT_TRUE(parse("/a_name_that_fits_in_32_bytes__", parsed));
+    TEST_ASSERT_EQUAL(FILE_NAME_MAX_LENGTH - 1, strlen(parsed.name));
+}
+
+void test_name_copied_up_to_its_length()
+{
+    char name[FILE_NAME_MAX_LENGTH];
+    TEST_ASSERT_TRUE(copyFileName(name, "/logs/old", 5));
+    TEST_ASSERT_EQUAL_STRING("/logs", name);
+    TEST_ASSERT_FALSE(copyFileName(name, "/logs", 0));
+}
+
+/***********\
+ * Listing *
+\***********/
+
+// Stubbed directory, more entries than fit in one page: files and sub-directories
+static std::vector<FileEntry> directory(int count)
+{
+    std::vector<FileEntry> entries(count);
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(entries[i].name, sizeof(entries[i].name), i % 10 == 9 ? "archive%02d" : "log%03d.txt", i);
+        entries[i].size = i % 10 == 9 ? 0 : 1000 * i + 17;
+        entries[i].mtime = 1700000000 + 60 * i;
+        entries[i].isDir = i % 10 == 9;
+    }
+    return entries;
+}
+
+// Lists the entries as dirList() does, returns the listing read back from the pages
+static std::string listPages(const char *dirName, const std::vector<FileEntry> &entries, size_t &pageCount)
+{
+    static DirPage page;
+    client.messages.clear();
+    dirPageBegin(page, dirName);
+
+    // Another topic with a variable part, built while the listing goes on
+    topicWith(TOPIC_FILE_DATA, "/log003.txt");
+
+    for (const FileEntry &entry : entries)
+    {
+        TEST_ASSERT_TRUE(dirPageAdd(entry, &page));
+    }
+    TEST_ASSERT_TRUE(dirPageSend(page, true));
+
+    std::string topic = std::string(getTopic(TOPIC_FILE_DIR)) + dirName;
+    std::vector<std::string> pages = client.payloads(topic.c_str());
+    TEST_ASSERT_EQUAL(client.messages.size(), pages.size());
+
+    std::string listing;
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        // "page,last\n" then whole lines
+        unsigned number, last;
+        int header = 0;
+        TEST_ASSERT_EQUAL(2, sscanf(pages[i].c_str(), "%u,%u\n%n", &number, &last, &header));
+        TEST_ASSERT_EQUAL(i, number);
+        TEST_ASSERT_EQUAL(i == pages.size() - 1, last);
+        TEST_ASSERT_EQUAL('\n', pages[i].back());
+
+        // Fixed header, topic length and topic, then the payload
+        TEST_ASSERT_LESS_OR_EQUAL(MQTT_MAX_PACKET_SIZE, 5 + 2 + topic.size() + pages[i].size());
+        listing += pages[i].substr(header);
+    }
+
+    pageCount = pages.size();
+    return listing;
+}
+
+static std::string expectedListing(const std::vector<FileEntry> &entries)
+{
+    std::string listing;
+    char line[FILE_NAME_MAX_LENGTH + 32];
+    for (const FileEntry &entry : entries)
+    {
+        snprintf(line, sizeof(line), "%s%s,%lu,%lu\n", entry.name, entry.isDir ? "/" : "",
+                 (unsigned long)entry.size, (unsigned long)entry.mtime);
+        listing += line;
+    }
+    return listing;
+}
+
+void test_listing_split_in_pages()
+{
+    std::vector<FileEntry> entries = directory(40);
+    size_t pages;
+    TEST_ASSERT_EQUAL_STRING(expectedListing(entries).c_str(), listPages("/", entries, pages).c_str());
+    TEST_ASSERT_GREATER_THAN(4, pages);
+}
+
+void test_listing_of_a_long_directory_name()
+{
+    // Less room per page, the same entries
+    std::vector<FileEntry> entries = directory(40);
+    size_t shortPages, longPages;
+    listPages("/", entries, shortPages);
+    std::string listing = listPages("/a_directory_name_of_31_chars__", entries, longPages);
+    TEST_ASSERT_EQUAL_STRING(expectedListing(entries).c_str(), listing.c_str());
+    TEST_ASSERT_GREATER_THAN(shortPages, longPages);
+}
+
+void test_empty_listing_has_one_page()
+{
+    size_t pages;
+    TEST_ASSERT_EQUAL_STRING("", listPages("/empty", {}, pages).c_str());
+    TEST_ASSERT_EQUAL(1, pages);
+}
+
+/*************\
+ * Benchmark *
+\*************/
+
+#define BENCHMARK_REQUESTS 10000
+
+void test_requests_do_not_use_the_heap()
+{
+    const char *requests[] = {"/log.3", "/log.3,2048", "/log.12,0,100", "/logs"};
+    FileRequest parsed;
+    char name[FILE_NAME_MAX_LENGTH];
+
+    allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCHMARK_REQUESTS; i++)
+    {
+        const char *request = requests[i % 4];
+        TEST_ASSERT_TRUE(parseFileRequest(request, strlen(request), parsed));
+        TEST_ASSERT_TRUE(copyFileName(name, request, strlen(request)));
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    char message[80];
+    snprintf(message, sizeof(message), "%d requests: %zu allocations, %.0f ns per request",
+             BENCHMARK_REQUESTS, allocations, elapsed.count() / BENCHMARK_REQUESTS);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, allocations);
+}
+
+int main(int argc, char **argv)
+{
+    initTopics();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_request_with_name_only);
+    RUN_TEST(test_request_with_range);
+    RUN_TEST(test_invalid_requests);
+    RUN_TEST(test_name_copied_up_to_its_length);
+    RUN_TEST(test_listing_split_in_pages);
+    RUN_TEST(test_listing_of_a_long_directory_name);
+    RUN_TEST(test_empty_listing_has_one_page);
+    RUN_TEST(test_requests_do_not_use_the_heap);
+    return UNITY_END();
+}
@@ -0,0 +1,270 @@
+#include <unity.h>
+#include <random>
+#include "main_globals.h"
+#include "measure.cpp"
+
+// The calibration is not under test
+void settingChanged(uint8_t setting, bool urgent) {}
+
+void setUp()
+{
+    burstThreshold = DEFAULT_BURST_THRESHOLD;
+    maxDifference = DEFAULT_MAX_DIFFERENCE;
+}
+
+void tearDown() {}
+
+// Distance from the formula, in mm
+static double expectedDistance(uint32_t width, double temp)
+{
+    return width * 331.3 * sqrt(1.0 + temp / 273.15) / 2000.0;
+}
+
+void test_echo_to_distance_follows_the_temperature()
+{
+    const int8_t temps[] = {-10, 0, 15, 20, 35, 50};
+    const uint32_t widths[] = {1166, 5831, 23000, 46600};
+
+    for (int8_t temp : temps)
+    {
+        for (uint32_t width : widths)
+        {
+            TEST_ASSERT_UINT_WITHIN(1, expectedDistance(width, temp), echoToDistance(width, temp));
+        }
+    }
+}
+
+void test_echo_to_distance_clamps_the_temperature()
+{
+    TEST_ASSERT_EQUAL(echoToDistance(23000, SOUND_TABLE_MIN_TEMP), echoToDistance(23000, -40));
+    TEST_ASSERT_EQUAL(echoToDistance(23000, SOUND_TABLE_MAX_TEMP), echoToDistance(23000, 80));
+    TEST_ASSERT_EQUAL(0, echoToDistance(0, 20));
+}
+
+void test_estimate_without_samples()
+{
+    BurstEstimate estimate = estimateDistance(nullptr, 0, 5);
+    TEST_ASSERT_EQUAL(-1, estimate.distance);
+    TEST_ASSERT_EQUAL(0, estimate.confidence);
+}
+
+void test_estimate_rejects_outliers()
+{
+    int16_t samples[] = {1001, 3000, 998, 1002, 1000};
+    BurstEstimate estimate = estimateDistance(samples, 5, 5);
+    TEST_ASSERT_EQUAL(1000, estimate.distance);
+    TEST_ASSERT_EQUAL(80, estimate.confidence);
+}
+
+void test_estimate_keeps_the_spread_minimum()
+{
+    // Mostly the same reading: the deviation is 0, the samples within
+    // BURST_MIN_SPREAD of the median are still kept
+    int16_t samples[] = {1500, 1500, 1500 + BURST_MIN_SPREAD, 1500, 1500 + BURST_MIN_SPREAD + 1};
+    BurstEstimate estimate = estimateDistance(samples, 5, 5);
+    TEST_ASSERT_EQUAL(1503, estimate.distance);
+    TEST_ASSERT_EQUAL(80, estimate.confidence);
+}
+
+void test_estimate_limited_by_max_difference()
+{
+    // Spread out readings: 3 MAD would keep them all
+    maxDifference = 50;
+    int16_t samples[] = {1000, 1100, 1200, 1300, 1400};
+    BurstEstimate estimate = estimateDistance(samples, 5, 5);
+    TEST_ASSERT_EQUAL(1200, estimate.distance);
+    TEST_ASSERT_EQUAL(20, estimate.confidence);
+}
+
+void test_estimate_even_count_and_missing_readings()
+{
+    // 4 readings out of 5 requested, the median is between the 2 middle ones
+    int16_t samples[] = {2004, 2000, 2010, 2002};
+    BurstEstimate estimate = estimateDistance(samples, 4, 5);
+    TEST_ASSERT_EQUAL(2004, estimate.distance);
+    TEST_ASSERT_EQUAL(80, estimate.confidence);
+}
+
+/****************\
+ * Noise traces *
+\****************/
+
+// A burst as getWaterLevel() takes it: the readings out of the sensor range
+// are left out, the confidence counts them as missing
+static BurstEstimate burst(const int *trace, uint8_t size)
+{
+    int16_t samples[MAX_BURST_SIZE];
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < size; i++)
+    {
+        if (trace[i] >= CLOSEST && trace[i] <= FARTHEST)
+        {
+            samples[count++] = trace[i];
+        }
+    }
+    return estimateDistance(samples, count, size);
+}
+
+struct Trace {
+    const char *name;
+    int         readings[DEFAULT_BURST_SIZE];
+    int         distance;
+    uint8_t     confidence;
+};
+
+static const Trace TRACES[] = {
+    {"spread out",             {1490, 1512, 1500, 1520, 1485},  1501, 100},
+    {"short echo",             {1502, 310, 1498, 1500, 1501},   1500, 80},
+    {"short and far echoes",   {1500, 420, 1503, 7900, 1497},   1500, 60},
+    {"echo off the wall",      {1200, 1810, 1203, 1805, 1198},  1200, 60},
+    {"wall echo in the lead",  {1810, 1805, 1200, 1808, 1203},  1808, 60},
+    {"one valid reading",      {-1, -1, -1, 2000, -1},          2000, 20},
+    {"split in 2 groups",      {-1, 500, -1, 7000, -1},         -1,   0},
+    {"no valid reading",       {0, -1, 150, 9000, -1},          -1,   0},
+};
+
+void test_estimate_on_noise_traces()
+{
+    for (const Trace &trace : TRACES)
+    {
+        BurstEstimate estimate = burst(trace.readings, DEFAULT_BURST_SIZE);
+        TEST_ASSERT_EQUAL_MESSAGE(trace.distance, estimate.distance, trace.name);
+        TEST_ASSERT_EQUAL_MESSAGE(trace.confidence, estimate.confidence, trace.name);
+    }
+}
+
+// The sensor: gaussian noise, echoes from anywhere in range and lost echoes
+class NoisySensor
+{
+    private:
+        std::mt19937 random{42};
+        std::normal_distribution<double> noise{0, 6};
+        std::uniform_real_distribution<double> draw{0, 1};
+        std::uniform_int_distribution<int> stray{CLOSEST, FARTHEST};
+
+    public:
+        int level = 2000;
+
+        int read()
+        {
+            double kind = draw(random);
+            if (kind < 0.05)
+            {
+                return -1;
+            }
+            if (kind < 0.20)
+            {
+                return stray(random);
+            }
+            return level + (int)lround(noise(random));
+        }
+};
+
+// The algorithm replaced by the burst: retry while the reading is too far
+// from the last measure, at most 4 times
+static int retryLoop(NoisySensor &sensor, uint16_t &lastMeasure)
+{
+    int distance = sensor.read();
+    int i = 0;
+    while ((distance < CLOSEST || abs(distance - lastMeasure) > maxDifference) && i < 4)
+    {
+        if (distance >= CLOSEST && abs(distance - lastMeasure) > maxDifference)
+        {
+            lastMeasure = (uint16_t)distance;
+        }
+        distance = sensor.read();
+        i++;
+    }
+    if (distance < CLOSEST || abs(distance - lastMeasure) > maxDifference)
+    {
+        return -1;
+    }
+    return distance;
+}
+
+struct Score {
+    int measures = 0;
+    int failed = 0;
+    int wrong = 0;          // more than 50 mm off
+    double error = 0;       // mm, sum over the good measures
+
+    void add(int distance, int level)
+    {
+        measures++;
+        if (distance < 0)
+        {
+            failed++;
+        }
+        else if (abs(distance - level) > 50)
+        {
+            wrong++;
+        }
+        else
+        {
+            error += abs(distance - level);
+        }
+    }
+
+    double average()
+    {
+        return error / (measures - failed - wrong);
+    }
+
+    void report(const char *name)
+    {
+        char message[96];
+        snprintf(message, sizeof(message), "%s: %d failed, %d wrong out of %d, %.1f mm average error", name,
+                 failed, wrong, measures, average());
+        TEST_MESSAGE(message);
+    }
+};
+
+void test_burst_against_the_retry_loop()
+{
+    NoisySensor sensor;
+    Score burstScore, retryScore;
+    uint16_t lastMeasure = sensor.level;
+
+    for (int i = 0; i < 2000; i++)
+    {
+        // The level moves slowly, as in a tank
+        sensor.level += i % 7 - 3;
+
+        int trace[DEFAULT_BURST_SIZE];
+        for (int &reading : trace)
+        {
+            reading = sensor.read();
+        }
+        BurstEstimate estimate = burst(trace, DEFAULT_BURST_SIZE);
+        burstScore.add(estimate.confidence >= BURST_MIN_CONFIDENCE ? estimate.distance : -1, sensor.level);
+
+        int distance = retryLoop(sensor, lastMeasure);
+        retryScore.add(distance, sensor.level);
+        if (distance >= 0)
+        {
+            lastMeasure = distance;
+        }
+    }
+
+    burstScore.report("burst");
+    retryScore.report("retry loop");
+    // Fewer wrong and more accurate measures, for more measures given up
+    TEST_ASSERT_LESS_THAN(retryScore.wrong, burstScore.wrong);
+    TEST_ASSERT_LESS_THAN(retryScore.average(), burstScore.average());
+    TEST_ASSERT_LESS_THAN(burstScore.measures / 10, burstScore.failed);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_echo_to_distance_follows_the_temperature);
+    RUN_TEST(test_echo_to_distance_clamps_the_temperature);
+    RUN_TEST(test_estimate_without_samples);
+    RUN_TEST(test_estimate_rejects_outliers);
+    RUN_TEST(test_estimate_keeps_the_spread_minimum);
+    RUN_TEST(test_estimate_limited_by_max_difference);
+    RUN_TEST(test_estimate_even_count_and_missing_readings);
+    RUN_TEST(test_estimate_on_noise_traces);
+    RUN_TEST(test_burst_against_the_retry_loop);
+    return UNITY_END();
+}
@@ -0,0 +1,200 @@
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include "main_globals.h"
+#include "MultiPrint.cpp"
+#include "PrintUtils.cpp"
+#include "BinaryLog.cpp"
+
+// Keeps what an output received
+class Capture : public Print
+{
+    public:
+        std::string text;
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *buffer, size_t size) override
+        {
+            text.append((const char *)buffer, size);
+            return size;
+        }
+};
+
+// Only counts the bytes, for the benchmark
+class Counter : public Print
+{
+    public:
+        size_t bytes = 0;
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *buffer, size_t size) override
+        {
+            bytes += size;
+            return size;
+        }
+};
+
+// As in setup(): the file takes the traces, MQTT only the notices
+static MultiPrint mp;
+static Capture file;
+static Capture mqtt;
+
+void setUp()
+{
+    logLevelFile = LOG_LEVEL_VERBOSE;
+    logLevelMqtt = LOG_LEVEL_NOTICE;
+    Log.setPrefix(printPrefix);
+    Log.begin(LOG_LEVEL_TRACE, &mp);
+    file.text.clear();
+    mqtt.text.clear();
+}
+
+void tearDown() {}
+
+// The text without the timestamp printed at the start of the log lines
+static std::string withoutTimestamps(const std::string &text)
+{
+    std::string lines;
+    size_t start = 0;
+    while (start < text.size())
+    {
+        size_t end = text.find('\n', start);
+        end = end == std::string::npos ? text.size() : end + 1;
+        std::string line = text.substr(start, end - start);
+        if (line.size() > 13 && line[5] == '-' && line[8] == '.' && line[12] == ' ')
+        {
+            line.erase(0, 13);
+        }
+        lines += line;
+        start = end;
+    }
+    return lines;
+}
+
+void test_outputs_filter_the_lines_before_begin()
+{
+    // No dispatcher yet: the writer writes to the outputs itself
+    Log.traceln(F("sync trace"));
+    Log.noticeln(F("sync notice %d"), 1);
+    mp.print("raw\n");
+
+    TEST_ASSERT_EQUAL_STRING("T: sync trace\nI: sync notice 1\nraw\n", withoutTimestamps(file.text).c_str());
+    TEST_ASSERT_EQUAL_STRING("I: sync notice 1\nraw\n", withoutTimestamps(mqtt.text).c_str());
+}
+
+void test_outputs_filter_the_queued_lines()
+{
+    TEST_ASSERT_TRUE(mp.begin());
+    Log.traceln(F("trace"));
+    Log.noticeln(F("notice"));
+    Log.verboseln(F("verbose"));
+    mp.print("raw\n");
+    mp.flush();
+
+    // The verbose line is above the level of the logger
+    TEST_ASSERT_EQUAL_STRING("T: trace\nI: notice\nraw\n", withoutTimestamps(file.text).c_str());
+    TEST_ASSERT_EQUAL_STRING("I: notice\nraw\n", withoutTimestamps(mqtt.text).c_str());
+    TEST_ASSERT_EQUAL(0, mp.getDropped());
+}
+
+void test_output_level_read_on_each_line()
+{
+    // The dispatcher reads the level when it writes the line
+    logLevelMqtt = LOG_LEVEL_TRACE;
+    Log.traceln(F("trace"));
+    mp.flush();
+    logLevelMqtt = LOG_LEVEL_SILENT;
+    Log.noticeln(F("notice"));
+    mp.flush();
+
+    TEST_ASSERT_EQUAL_STRING("T: trace\nI: notice\n", withoutTimestamps(file.text).c_str());
+    TEST_ASSERT_EQUAL_STRING("T: trace\n", withoutTimestamps(mqtt.text).c_str());
+}
+
+void test_long_line_keeps_its_level()
+{
+    // Several records, all filtered on the level of the line
+    std::string line(3 * MULTI_PRINT_RECORD_SIZE, 'x');
+    Log.traceln(F("%s"), line.c_str());
+    Log.noticeln(F("end"));
+    mp.flush();
+
+    TEST_ASSERT_EQUAL_STRING(("T: " + line + "\nI: end\n").c_str(), withoutTimestamps(file.text).c_str());
+    TEST_ASSERT_EQUAL_STRING("I: end\n", withoutTimestamps(mqtt.text).c_str());
+}
+
+/*************\
+ * Benchmark *
+\*************/
+
+#define BENCHMARK_WAKES 2000
+
+// The lines of a wake that reports, with 2 probes
+static void wakeLog()
+{
+    Log.noticeln(F("Loaded %l bytes from log buffer"), 812L);
+    Log.traceln(F("RTC Data:"));
+    Log.traceln(F(" - rtcValid: %T"), true);
+    Log.traceln(F(" - BSSID: %x:%x:%x:%x:%x:%x"), 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56);
+    Log.traceln(F(" - channel: %d"), 6);
+    Log.traceln(F(" - failedConnection: %d"), 0);
+    Log.traceln(F(" - logLevel: %d"), logLevel);
+    Log.traceln(F("Battery voltage = %F V"), 3.91);
+    for (int probe = 0; probe < 2; probe++)
+    {
+        Log.traceln("Triggering on port %u and listening echo on port %u", 4 + probe, 6 + probe);
+        for (int i = 0; i < 5; i++)
+        {
+            Log.verboseln(F("Reading %d of probe %d out of range: %d mm"), i, probe, 4800);
+        }
+        Log.verboseln(F("Probe %d: %d of %d readings kept, confidence %d%%"), probe, 5, 5, 80);
+        Log.noticeln("Distance %d: %d mm", probe, 1234);
+    }
+    Log.noticeln(F("Measurements sent"));
+    Log.verboseln(F("Going to sleep"));
+}
+
+void test_formatting_cost_per_level()
+{
+    Counter output;
+    size_t lastBytes = 0;
+
+    for (int level = LOG_LEVEL_SILENT; level <= LOG_LEVEL_VERBOSE; level++)
+    {
+        output.bytes = 0;
+        Log.begin(level, &output);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BENCHMARK_WAKES; i++)
+        {
+            wakeLog();
+        }
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+        char message[80];
+        snprintf(message, sizeof(message), "level %d: %zu bytes, %.2f us per wake",
+                 level, output.bytes / BENCHMARK_WAKES, elapsed.count() / BENCHMARK_WAKES);
+        TEST_MESSAGE(message);
+
+        // The lines above the level cost nothing
+        if (level == LOG_LEVEL_SILENT)
+        {
+            TEST_ASSERT_EQUAL(0, output.bytes);
+        }
+        TEST_ASSERT_GREATER_OR_EQUAL(lastBytes, output.bytes);
+        lastBytes = output.bytes;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    mp.addOutput(&file, LOG_SINK_BLOCK, &logLevelFile);
+    mp.addOutput(&mqtt, LOG_SINK_BLOCK, &logLevelMqtt);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_outputs_filter_the_lines_before_begin);
+    RUN_TEST(test_outputs_filter_the_queued_lines);
+    RUN_TEST(test_output_level_read_on_each_line);
+    RUN_TEST(test_long_line_keeps_its_level);
+    RUN_TEST(test_formatting_cost_per_level);
+    return UNITY_END();
+}
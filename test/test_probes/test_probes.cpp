@@ -0,0 +1,138 @@
+#include <unity.h>
+#include <vector>
+#include "probes.h"
+
+typedef ProbeArray<Probe<4, 5, 0>> OneProbe;
+typedef ProbeArray<Probe<4, 5, 0>, Probe<6, 7, 0>> TwoProbes;
+typedef ProbeArray<Probe<10, 11, 0>, Probe<12, 13, 0>, Probe<14, 15, 1>, Probe<16, 17, 1>> FourProbes;
+typedef ProbeArray<Probe<10, 11, 1>, Probe<12, 13, 0>, Probe<14, 15, 1>, Probe<16, 17, 2>> ThreeTanks;
+
+// One call of the measure loop
+struct Fired {
+    uint8_t  index;
+    uint8_t  trigPin;
+    uint8_t  echoPin;
+    uint32_t settle;                    // ms since the previous probe
+};
+
+static std::vector<Fired> fired;
+
+template <typename Array>
+static void measureAll()
+{
+    int64_t last = stubMicros;
+    Array::measure([&last](uint8_t i, uint8_t trigPin, uint8_t echoPin) {
+        fired.push_back({i, trigPin, echoPin, (uint32_t)((stubMicros - last) / 1000)});
+        last = stubMicros;
+    });
+}
+
+// Each probe: trigger as output, echo as input, trigger low, in index order
+template <typename Array>
+static void checkInit()
+{
+    stubPinCalls.clear();
+    Array::init();
+
+    TEST_ASSERT_EQUAL(3 * Array::count, stubPinCalls.size());
+    for (uint8_t i = 0; i < Array::count; i++)
+    {
+        const StubPinCall *calls = &stubPinCalls[3 * i];
+        TEST_ASSERT_EQUAL('M', calls[0].call);
+        TEST_ASSERT_EQUAL(Array::trigAt(i), calls[0].pin);
+        TEST_ASSERT_EQUAL(OUTPUT, calls[0].value);
+        TEST_ASSERT_EQUAL('M', calls[1].call);
+        TEST_ASSERT_EQUAL(Array::echoAt(i), calls[1].pin);
+        TEST_ASSERT_EQUAL(INPUT, calls[1].value);
+        TEST_ASSERT_EQUAL('W', calls[2].call);
+        TEST_ASSERT_EQUAL(Array::trigAt(i), calls[2].pin);
+        TEST_ASSERT_EQUAL(LOW, calls[2].value);
+    }
+}
+
+// The probes fired in this order, each one with its own pins
+template <typename Array>
+static void checkMeasure(const std::vector<uint8_t> &order, const std::vector<uint32_t> &settle)
+{
+    fired.clear();
+    measureAll<Array>();
+
+    TEST_ASSERT_EQUAL(order.size(), fired.size());
+    uint32_t total = 0;
+    for (size_t slot = 0; slot < fired.size(); slot++)
+    {
+        TEST_ASSERT_EQUAL(order[slot], fired[slot].index);
+        TEST_ASSERT_EQUAL(Array::trigAt(order[slot]), fired[slot].trigPin);
+        TEST_ASSERT_EQUAL(Array::echoAt(order[slot]), fired[slot].echoPin);
+        TEST_ASSERT_EQUAL(settle[slot], fired[slot].settle);
+        total += fired[slot].settle;
+    }
+    TEST_ASSERT_EQUAL(Array::settleTime(), total);
+}
+
+void setUp()
+{
+    stubMicros = 0;
+}
+
+void tearDown() {}
+
+void test_one_probe()
+{
+    checkInit<OneProbe>();
+    checkMeasure<OneProbe>({0}, {0});
+    TEST_ASSERT_EQUAL(4, OneProbe::trigAt(0));
+    TEST_ASSERT_EQUAL(5, OneProbe::echoAt(0));
+    TEST_ASSERT_EQUAL(0, OneProbe::tankAt(0));
+}
+
+void test_two_probes_in_one_tank()
+{
+    // The second probe waits for the echoes of the first one to die down
+    checkInit<TwoProbes>();
+    checkMeasure<TwoProbes>({0, 1}, {0, PROBE_SETTLE_SAME_TANK_MS});
+    TEST_ASSERT_EQUAL(6, TwoProbes::trigAt(1));
+    TEST_ASSERT_EQUAL(7, TwoProbes::echoAt(1));
+    TEST_ASSERT_EQUAL(0, TwoProbes::tankAt(1));
+}
+
+void test_four_probes_in_two_tanks()
+{
+    // The tanks take turns, so no probe waits for the long settle time
+    checkInit<FourProbes>();
+    checkMeasure<FourProbes>({0, 2, 1, 3}, {0, PROBE_SETTLE_OTHER_TANK_MS, PROBE_SETTLE_OTHER_TANK_MS,
+                                            PROBE_SETTLE_OTHER_TANK_MS});
+
+    const uint8_t tanks[] = {0, 0, 1, 1};
+    for (uint8_t i = 0; i < FourProbes::count; i++)
+    {
+        TEST_ASSERT_EQUAL(10 + 2 * i, FourProbes::trigAt(i));
+        TEST_ASSERT_EQUAL(11 + 2 * i, FourProbes::echoAt(i));
+        TEST_ASSERT_EQUAL(tanks[i], FourProbes::tankAt(i));
+    }
+}
+
+void test_four_probes_in_three_tanks()
+{
+    // Declared out of tank order: the second probe of tank 1 comes last
+    checkInit<ThreeTanks>();
+    checkMeasure<ThreeTanks>({0, 1, 3, 2}, {0, PROBE_SETTLE_OTHER_TANK_MS, PROBE_SETTLE_OTHER_TANK_MS,
+                                            PROBE_SETTLE_OTHER_TANK_MS});
+
+    const uint8_t tanks[] = {1, 0, 1, 2};
+    for (uint8_t i = 0; i < ThreeTanks::count; i++)
+    {
+        TEST_ASSERT_EQUAL(tanks[i], ThreeTanks::tankAt(i));
+        TEST_ASSERT_EQUAL(i, ThreeTanks::probeAt(ThreeTanks::slotOf(i)));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_one_probe);
+    RUN_TEST(test_two_probes_in_one_tank);
+    RUN_TEST(test_four_probes_in_two_tanks);
+    RUN_TEST(test_four_probes_in_three_tanks);
+    return UNITY_END();
+}
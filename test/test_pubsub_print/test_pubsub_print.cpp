@@ -0,0 +1,159 @@
+#include <unity.h>
+#include <string>
+#include "PubSubPrint.cpp"
+
+static PubSubClient client;
+static PubSubPrint *printer;
+
+void setUp()
+{
+    client = PubSubClient();
+    printer = new PubSubPrint(&client, "water/log");
+}
+
+void tearDown()
+{
+    delete printer;
+}
+
+static std::string writeLines(PubSubPrint &output, int first, int count)
+{
+    std::string written;
+    for (int i = first; i < first + count; i++)
+    {
+        char line[64];
+        int length = snprintf(line, sizeof(line), "00012-34.%03d N: line %d with some padding\n", i, i);
+        output.write((const uint8_t *)line, length);
+        written.append(line, length);
+    }
+    return written;
+}
+
+// The messages joined with the newline removed at the end of each one
+static std::string received()
+{
+    std::string text;
+    for (const std::string &payload : client.payloads("water/log"))
+    {
+        TEST_ASSERT_LESS_OR_EQUAL(PUBSUB_PRINT_PACKET_SIZE, payload.size());
+        text += payload + "\n";
+    }
+    return text;
+}
+
+void test_lines_kept_until_resumed()
+{
+    printer->setSuspend(true);
+    std::string written = writeLines(*printer, 0, 10);
+    TEST_ASSERT_EQUAL(0, client.messages.size());
+
+    printer->setSuspend(false);
+    TEST_ASSERT_EQUAL_STRING(written.c_str(), received().c_str());
+    TEST_ASSERT_EQUAL(0, printer->getDropped());
+}
+
+void test_messages_end_on_a_line()
+{
+    printer->setSuspend(true);
+    std::string written = writeLines(*printer, 0, 20);
+    printer->setSuspend(false);
+
+    // Several lines per message, and no line cut in 2
+    TEST_ASSERT_GREATER_THAN(1, client.messages.size());
+    TEST_ASSERT_LESS_OR_EQUAL(written.size() / PUBSUB_PRINT_PACKET_SIZE + 1, client.messages.size());
+    TEST_ASSERT_EQUAL_STRING(written.c_str(), received().c_str());
+}
+
+void test_partial_line_waits_for_its_end()
+{
+    printer->write((const uint8_t *)"begin of", 8);
+    printer->flush();
+    TEST_ASSERT_EQUAL(0, client.messages.size());
+
+    printer->write((const uint8_t *)" the line\n", 10);
+    printer->flush();
+    TEST_ASSERT_EQUAL_STRING("begin of the line\n", received().c_str());
+}
+
+void test_full_buffer_keeps_the_oldest()
+{
+    printer->setSuspend(true);
+    std::string written = writeLines(*printer, 0, 40);
+    TEST_ASSERT_EQUAL(written.size() - PUBSUB_PRINT_BUFFER_SIZE, printer->getDropped());
+
+    // The lines come out in order until the one cut by the full buffer
+    printer->setSuspend(false);
+    printer->write((const uint8_t *)"\n", 1);
+    printer->flush();
+    std::string text = received();
+    TEST_ASSERT_EQUAL(PUBSUB_PRINT_BUFFER_SIZE + 1, text.size());
+    TEST_ASSERT_EQUAL(0, written.compare(0, PUBSUB_PRINT_BUFFER_SIZE, text, 0, PUBSUB_PRINT_BUFFER_SIZE));
+}
+
+void test_ring_wraps_around()
+{
+    std::string written;
+    for (int i = 0; i < 100; i += 5)
+    {
+        written += writeLines(*printer, i, 5);
+        printer->flush();
+    }
+    TEST_ASSERT_EQUAL_STRING(written.c_str(), received().c_str());
+}
+
+void test_long_line_sent_in_pieces()
+{
+    std::string line(PUBSUB_PRINT_PACKET_SIZE + 100, 'x');
+    printer->write((const uint8_t *)line.data(), line.size());
+    printer->flush();
+    TEST_ASSERT_EQUAL(1, client.messages.size());
+
+    printer->write((const uint8_t *)"\n", 1);
+    printer->flush();
+    TEST_ASSERT_EQUAL(2, client.messages.size());
+    TEST_ASSERT_EQUAL_STRING(line.c_str(), (client.messages[0].payload + client.messages[1].payload).c_str());
+}
+
+void test_lines_survive_the_deep_sleep()
+{
+    // Lines not sent before sleeping are saved in RTC memory
+    printer->setSuspend(true);
+    std::string written = writeLines(*printer, 0, 5);
+    printer->write((const uint8_t *)"partial", 7);
+    uint8_t rtc[PUBSUB_PRINT_BUFFER_SIZE];
+    size_t length = printer->saveBufferData(rtc, sizeof(rtc));
+
+    PubSubPrint next(&client, "water/log");
+    next.setSuspend(true);
+    next.loadBufferData(rtc, length);
+    next.write((const uint8_t *)" end\n", 5);
+    next.setSuspend(false);
+
+    TEST_ASSERT_EQUAL_STRING((written + "partial end\n").c_str(), received().c_str());
+}
+
+void test_lines_kept_while_disconnected()
+{
+    client.online = false;
+    std::string written = writeLines(*printer, 0, 3);
+    printer->flush();
+    TEST_ASSERT_EQUAL(0, client.messages.size());
+
+    client.online = true;
+    printer->flush();
+    TEST_ASSERT_EQUAL_STRING(written.c_str(), received().c_str());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_lines_kept_until_resumed);
+    RUN_TEST(test_messages_end_on_a_line);
+    RUN_TEST(test_partial_line_waits_for_its_end);
+    RUN_TEST(test_full_buffer_keeps_the_oldest);
+    RUN_TEST(test_ring_wraps_around);
+    RUN_TEST(test_long_line_sent_in_pieces);
+    RUN_TEST(test_lines_survive_the_deep_sleep);
+    RUN_TEST(test_lines_kept_while_disconnected);
+    return UNITY_END();
+}
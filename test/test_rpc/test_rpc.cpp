@@ -0,0 +1,142 @@
+#define ARDUINOJSON_ENABLE_ARDUINO_PRINT 1
+
+#include <unity.h>
+#include <string>
+#include "main_globals.h"
+#include "rpc.cpp"
+#include "connection.cpp"
+#include "topics.cpp"
+#include "files.cpp"
+#include "FilePrint.cpp"
+#include "PubSubPrint.cpp"
+#include "MultiPrint.cpp"
+#include "PrintUtils.cpp"
+#include "BinaryLog.cpp"
+
+// Only the queue and the "stats" method are under test
+int  applyConfig(JsonObjectConst config) { return 0; }
+bool firmwareUpdate(const char *url) { return false; }
+bool fileGet(const char *request, size_t length) { return false; }
+int  dirList(const char *request, size_t length) { return -1; }
+int  getWaterLevel(uint8_t trigPin, uint8_t echoPin, uint8_t index) { return 0; }
+uint16_t batchCount() { return 0; }
+uint32_t configLoadSaved = 0;
+
+PubSubPrint mqttLog(&client, "water/log");
+FilePrint   fileLog;
+MultiPrint  logOutput;
+
+// The RPC part of the handler of mqtt.cpp
+void callback(char *topic, byte *payload, unsigned int length)
+{
+    if (topicId(topic) == TOPIC_RPC_REQUEST)
+    {
+        rpcQueue(payload, length);
+    }
+}
+
+void setUp()
+{
+    client = PubSubClient();
+    client.linked = false;
+    persistentSession = 0;
+    sessionSubscribed = false;
+    rpcCount = 0;
+    run = 1;
+}
+
+void tearDown() {}
+
+// One wake as in setup(): connect, receive, answer, go to sleep. Returns the
+// number of responses sent.
+static size_t wake()
+{
+    client.messages.clear();
+    TEST_ASSERT_TRUE(reconnect());
+    client.loop();
+    rpcProcess();
+    client.disconnect();
+    run++;
+
+    size_t responses = 0;
+    for (const PubSubClient::Message &message : client.messages)
+    {
+        responses += message.topic.rfind(getTopic(TOPIC_RPC_RESPONSE), 0) == 0;
+    }
+    return responses;
+}
+
+// Published by another client while the device sleeps
+static void request(const char *payload, bool retain)
+{
+    client.deliver(getTopic(TOPIC_RPC_REQUEST), payload, retain);
+}
+
+void test_retained_request_answered_once()
+{
+    wake();
+    request("{\"id\":7,\"method\":\"stats\"}", true);
+
+    // Sent again by the broker on the SUBSCRIBE of each wake until removed
+    TEST_ASSERT_EQUAL(1, wake());
+    TEST_ASSERT_EQUAL(1, client.payloads((std::string(getTopic(TOPIC_RPC_RESPONSE)) + "/7").c_str()).size());
+    TEST_ASSERT_EQUAL(0, client.retainedMessages.count(getTopic(TOPIC_RPC_REQUEST)));
+    for (int i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_EQUAL(0, wake());
+    }
+}
+
+void test_request_not_retained()
+{
+    persistentSession = 1;
+    wake();
+    request("{\"id\":\"a\",\"method\":\"stats\"}", false);
+    TEST_ASSERT_EQUAL(1, wake());
+    TEST_ASSERT_EQUAL(0, wake());
+}
+
+void test_too_long_request_removed()
+{
+    wake();
+    request(("{\"id\":8,\"method\":\"stats\",\"pad\":\"" + std::string(RPC_REQUEST_MAX_LENGTH, 'x') + "\"}").c_str(), true);
+    TEST_ASSERT_EQUAL(0, wake());
+    TEST_ASSERT_EQUAL(0, client.retainedMessages.count(getTopic(TOPIC_RPC_REQUEST)));
+}
+
+void test_request_left_retained_when_the_queue_is_full()
+{
+    // Queued but not answered yet: the retained one comes back once there is room
+    persistentSession = 1;
+    wake();
+    for (uint8_t i = 0; i < RPC_QUEUE_SIZE; i++)
+    {
+        TEST_ASSERT_TRUE(rpcQueue((const uint8_t *)"{\"id\":1,\"method\":\"reboot\"}", 27));
+    }
+    request("{\"id\":9,\"method\":\"stats\"}", true);
+
+    client.messages.clear();
+    TEST_ASSERT_TRUE(reconnect());
+    client.loop();
+    TEST_ASSERT_EQUAL(RPC_QUEUE_SIZE, rpcCount);
+    TEST_ASSERT_EQUAL(1, client.retainedMessages.count(getTopic(TOPIC_RPC_REQUEST)));
+    rpcProcess();
+    client.disconnect();
+
+    // A clean session gets the retained message again
+    persistentSession = 0;
+    TEST_ASSERT_EQUAL(1, wake());
+    TEST_ASSERT_EQUAL(0, client.retainedMessages.count(getTopic(TOPIC_RPC_REQUEST)));
+}
+
+int main(int argc, char **argv)
+{
+    initTopics();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_retained_request_answered_once);
+    RUN_TEST(test_request_not_retained);
+    RUN_TEST(test_too_long_request_removed);
+    RUN_TEST(test_request_left_retained_when_the_queue_is_full);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "main_globals.h"
+#include "connection.cpp"
+#include "topics.cpp"
+
+// Messages given to the handler of mqtt.cpp
+static std::vector<std::string> received;
+
+void callback(char *topic, byte *payload, unsigned int length)
+{
+    received.push_back(std::string(topic) + " " + std::string((char *)payload, length));
+}
+
+void setUp()
+{
+    client = PubSubClient();
+    client.linked = false;
+    received.clear();
+    sessionSubscribed = false;
+    run = 1;
+}
+
+void tearDown() {}
+
+// One wake as in setup(): connect, receive until the queue is empty, go to sleep
+static void wake()
+{
+    client.subscribed.clear();
+    TEST_ASSERT_TRUE(reconnect());
+    client.loop();
+    client.disconnect();
+    run++;
+}
+
+void test_persistent_session_resumed_without_subscribe()
+{
+    persistentSession = 1;
+    wake();
+
+    // First wake: every command topic subscribed with QoS 1, on a stable client ID
+    TEST_ASSERT_FALSE(client.sessionPresent);
+    TEST_ASSERT_EQUAL(TOPIC_SUBSCRIBED_COUNT, client.subscribed.size());
+    for (uint8_t id = 0; id < TOPIC_SUBSCRIBED_COUNT; id++)
+    {
+        TEST_ASSERT_EQUAL_STRING(getTopic(id), client.subscribed[id].topic.c_str());
+        TEST_ASSERT_EQUAL(1, client.subscribed[id].qos);
+    }
+    TEST_ASSERT_TRUE(sessionSubscribed);
+    TEST_ASSERT_EQUAL_STRING("waterLevel-240ac4123456", client.lastClientId.c_str());
+
+    // The next wakes find the session back and send no SUBSCRIBE
+    for (int i = 0; i < 5; i++)
+    {
+        wake();
+        TEST_ASSERT_TRUE(client.sessionPresent);
+        TEST_ASSERT_EQUAL(0, client.subscribed.size());
+        TEST_ASSERT_EQUAL_STRING("waterLevel-240ac4123456", client.lastClientId.c_str());
+    }
+}
+
+void test_command_delivered_after_sleep()
+{
+    persistentSession = 1;
+    wake();
+
+    // Sent while the device sleeps, not retained
+    client.deliver(getTopic(TOPIC_RPC_REQUEST), "{\"id\":\"1\",\"method\":\"stats\"}");
+    client.deliver(getTopic(TOPIC_UPDATE_URL), "http://ota/firmware.bin");
+    TEST_ASSERT_EQUAL(0, received.size());
+
+    wake();
+    TEST_ASSERT_EQUAL(0, client.subscribed.size());
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL_STRING("water/rpc/request {\"id\":\"1\",\"method\":\"stats\"}", received[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("water/update/url http://ota/firmware.bin", received[1].c_str());
+
+    // Delivered once
+    wake();
+    TEST_ASSERT_EQUAL(2, received.size());
+}
+
+void test_session_refreshed_periodically()
+{
+    // The broker may have lost the session: subscribe again from time to time
+    persistentSession = 1;
+    wake();
+    run = SESSION_REFRESH_INTERVAL;
+    wake();
+    TEST_ASSERT_EQUAL(TOPIC_SUBSCRIBED_COUNT, client.subscribed.size());
+    wake();
+    TEST_ASSERT_EQUAL(0, client.subscribed.size());
+}
+
+void test_session_lost_by_the_broker()
+{
+    persistentSession = 1;
+    wake();
+
+    // Broker restarted without persistence: the flag alone would skip the SUBSCRIBE
+    client.sessionId.clear();
+    client.subscriptions.clear();
+    wake();
+    TEST_ASSERT_FALSE(client.sessionPresent);
+    TEST_ASSERT_EQUAL(0, client.subscribed.size());
+
+    // Nothing reaches the device until the refresh
+    client.deliver(getTopic(TOPIC_CONFIG), "{\"burstSize\":9}");
+    run = SESSION_REFRESH_INTERVAL;
+    wake();
+    TEST_ASSERT_EQUAL(0, received.size());
+    client.deliver(getTopic(TOPIC_CONFIG), "{\"burstSize\":9}");
+    wake();
+    TEST_ASSERT_EQUAL(1, received.size());
+}
+
+void test_clean_session_subscribes_on_every_wake()
+{
+    persistentSession = 0;
+    wake();
+    TEST_ASSERT_EQUAL(TOPIC_SUBSCRIBED_COUNT, client.subscribed.size());
+    TEST_ASSERT_EQUAL(0, client.subscribed[0].qos);
+    TEST_ASSERT_FALSE(sessionSubscribed);
+
+    // A command sent during the sleep is lost unless retained
+    client.deliver(getTopic(TOPIC_RPC_REQUEST), "{\"id\":\"2\",\"method\":\"stats\"}");
+    wake();
+    TEST_ASSERT_FALSE(client.sessionPresent);
+    TEST_ASSERT_EQUAL(TOPIC_SUBSCRIBED_COUNT, client.subscribed.size());
+    TEST_ASSERT_EQUAL(0, received.size());
+}
+
+int main(int argc, char **argv)
+{
+    initTopics();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_persistent_session_resumed_without_subscribe);
+    RUN_TEST(test_command_delivered_after_sleep);
+    RUN_TEST(test_session_refreshed_periodically);
+    RUN_TEST(test_session_lost_by_the_broker);
+    RUN_TEST(test_clean_session_subscribes_on_every_wake);
+    return UNITY_END();
+}
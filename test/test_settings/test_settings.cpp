@@ -0,0 +1,271 @@
+#include <unity.h>
+#include "main_globals.h"
+#include "settings.cpp"
+#include "topics.cpp"
+
+void setUp()
+{
+    Preferences::erase();
+    Preferences preferences;
+    preferences.begin(SETTINGS_NAMESPACE);
+    run = 0;
+    loadSettings(preferences);
+    settingsDirty = 0;
+    settingsUrgent = false;
+    lastCommitRun = 0;
+}
+
+void tearDown() {}
+
+void test_find_setting_by_name()
+{
+    uint8_t index = 9;
+    const SettingInfo *info = findSetting("logLevel", index);
+    TEST_ASSERT_NOT_NULL(info);
+    TEST_ASSERT_EQUAL_STRING("logLevel", info->name);
+    TEST_ASSERT_EQUAL(0, index);
+
+    // Not a prefix match
+    TEST_ASSERT_EQUAL_STRING("logLevelSerial", findSetting("logLevelSerial", index)->name);
+    TEST_ASSERT_NULL(findSetting("logLevelSer", index));
+    TEST_ASSERT_NULL(findSetting("log", index));
+    TEST_ASSERT_NULL(findSetting("unknown", index));
+}
+
+void test_find_probe_setting()
+{
+    uint8_t index = 0;
+    const SettingInfo *info = findSetting("minLevel[1]", index);
+    TEST_ASSERT_NOT_NULL(info);
+    TEST_ASSERT_EQUAL_STRING("minLevel", info->name);
+    TEST_ASSERT_EQUAL(1, index);
+
+    char key[16];
+    snprintf(key, sizeof(key), "minLevel[%d]", PROBE_COUNT);
+    TEST_ASSERT_NULL(findSetting(key, index));
+    TEST_ASSERT_NULL(findSetting("sleepTime[1]", index));
+}
+
+void test_apply_setting_in_range()
+{
+    uint8_t index;
+    const SettingInfo *info = findSetting("burstSize", index);
+    TEST_ASSERT_TRUE(applySetting(info, index, 9));
+    TEST_ASSERT_EQUAL(9, burstSize);
+    TEST_ASSERT_TRUE(settingsDirty & (1ULL << SETTING_BURST_SIZE));
+    TEST_ASSERT_TRUE(settingsUrgent);
+
+    // Same value again
+    settingsDirty = 0;
+    TEST_ASSERT_FALSE(applySetting(info, index, 9));
+    TEST_ASSERT_EQUAL(0, settingsDirty);
+}
+
+void test_apply_setting_out_of_range()
+{
+    uint8_t index;
+
+    // Rejected
+    const SettingInfo *info = findSetting("burstSize", index);
+    TEST_ASSERT_FALSE(applySetting(info, index, MAX_BURST_SIZE + 1));
+    TEST_ASSERT_FALSE(applySetting(info, index, NAN));
+    TEST_ASSERT_EQUAL(DEFAULT_BURST_SIZE, burstSize);
+
+    // Clamped
+    info = findSetting("maxLevel[1]", index);
+    TEST_ASSERT_TRUE(applySetting(info, index, 100));
+    TEST_ASSERT_EQUAL(CLOSEST, maxLevel[1]);
+    TEST_ASSERT_EQUAL(FARTHEST, maxLevel[0]);
+    TEST_ASSERT_EQUAL(1ULL << (SETTING_MAX_LEVEL + 1), settingsDirty);
+}
+
+void test_apply_setting_scale()
+{
+    uint8_t index;
+    const SettingInfo *info = findSetting("sleepTime", index);
+    TEST_ASSERT_TRUE(applySetting(info, index, 60));
+    TEST_ASSERT_EQUAL_UINT64(60000000ULL, sleepTime);
+
+    info = findSetting("onPowerThreshold", index);
+    TEST_ASSERT_TRUE(applySetting(info, index, 3.7));
+    TEST_ASSERT_EQUAL_FLOAT(3.7f, onPowerThreshold);
+}
+
+void test_apply_setting_calls_on_change()
+{
+    uint8_t index;
+    const SettingInfo *info = findSetting("persistentSession", index);
+    sessionSubscribed = true;
+    TEST_ASSERT_TRUE(applySetting(info, index, 1));
+    TEST_ASSERT_FALSE(sessionSubscribed);
+}
+
+// The binary log is not under test
+void binaryLogBegin(Print *output) {}
+
+// Discards the log
+class NullPrint : public Print
+{
+    public:
+        size_t write(uint8_t c) override { return 1; }
+};
+
+void test_log_level_lowered_to_the_outputs()
+{
+    static NullPrint output;
+    Log.begin(LOG_LEVEL_SILENT, &output);
+
+    uint8_t index;
+    TEST_ASSERT_TRUE(applySetting(findSetting("logLevel", index), 0, LOG_LEVEL_VERBOSE));
+    TEST_ASSERT_EQUAL(LOG_LEVEL_VERBOSE, Log.getLevel());
+
+    // No output takes the verbose lines: they are not formatted
+    applySetting(findSetting("logLevelSerial", index), 0, LOG_LEVEL_WARNING);
+    applySetting(findSetting("logLevelFile", index), 0, LOG_LEVEL_NOTICE);
+    applySetting(findSetting("logLevelMqtt", index), 0, LOG_LEVEL_TRACE);
+    TEST_ASSERT_EQUAL(LOG_LEVEL_TRACE, Log.getLevel());
+    TEST_ASSERT_EQUAL(ESP_LOG_DEBUG, stubEspLogLevel);
+
+    // logLevel still limits every output
+    applySetting(findSetting("logLevel", index), 0, LOG_LEVEL_ERROR);
+    TEST_ASSERT_EQUAL(LOG_LEVEL_ERROR, Log.getLevel());
+    TEST_ASSERT_EQUAL(ESP_LOG_ERROR, stubEspLogLevel);
+}
+
+/****************\
+ * Flash writes *
+\****************/
+
+#define WAKES_PER_DAY ((uint32_t)(86400 * 1e6 / DEFAULT_SLEEP_TIME))
+
+// End of a wake, as in startSleep()
+static void sleep()
+{
+    run = (run + 1) % 100000;
+    runChanged();
+    commitSettings();
+    sealSettings();
+}
+
+void test_run_counter_written_at_checkpoints()
+{
+    Preferences::writes = 0;
+    for (uint32_t i = 0; i < WAKES_PER_DAY; i++)
+    {
+        sleep();
+    }
+
+    char message[64];
+    snprintf(message, sizeof(message), "%u NVS writes for %u wakes", Preferences::writes, WAKES_PER_DAY);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_OR_EQUAL(WAKES_PER_DAY / RUN_CHECKPOINT_INTERVAL + 1, Preferences::writes);
+    TEST_ASSERT_GREATER_OR_EQUAL(WAKES_PER_DAY / RUN_CHECKPOINT_INTERVAL, Preferences::writes);
+}
+
+void test_calibration_changes_grouped()
+{
+    // Worst case: the levels are adapted on every wake
+    Preferences::writes = 0;
+    for (uint32_t i = 0; i < WAKES_PER_DAY; i++)
+    {
+        minLevel[0] = FARTHEST - i % 100;
+        settingChanged(SETTING_MIN_LEVEL);
+        sleep();
+    }
+
+    char message[64];
+    snprintf(message, sizeof(message), "%u NVS writes for %u wakes", Preferences::writes, WAKES_PER_DAY);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_OR_EQUAL(WAKES_PER_DAY / SETTINGS_COMMIT_INTERVAL + WAKES_PER_DAY / RUN_CHECKPOINT_INTERVAL + 1,
+                              Preferences::writes);
+
+    // The last value is in flash
+    Preferences preferences;
+    preferences.begin(SETTINGS_NAMESPACE);
+    settingsDirty |= 1ULL << SETTING_MIN_LEVEL;
+    settingsUrgent = true;
+    commitSettings();
+    TEST_ASSERT_EQUAL(minLevel[0], preferences.getInt("minLevel-0"));
+}
+
+void test_config_change_written_at_once()
+{
+    // Just after a commit
+    settingChanged(SETTING_BURST_SIZE);
+    settingsUrgent = true;
+    commitSettings();
+
+    uint8_t index;
+    Preferences::writes = 0;
+    TEST_ASSERT_TRUE(applySetting(findSetting("burstSize", index), 0, 7));
+    sleep();
+    TEST_ASSERT_EQUAL(1, Preferences::writes);
+
+    Preferences preferences;
+    preferences.begin(SETTINGS_NAMESPACE);
+    TEST_ASSERT_EQUAL(7, preferences.getUChar("burstSize"));
+}
+
+void test_legacy_keys_migrated_once()
+{
+    // Keys of the previous versions: "minLevel-" shifted by the probe index
+    Preferences::erase();
+    Preferences preferences;
+    preferences.begin(SETTINGS_NAMESPACE);
+    preferences.putInt("minLevel-", 3000);
+    preferences.putInt("inLevel-", 3100);
+    preferences.putInt("maxLevel-", 500);
+
+    loadSettings(preferences);
+    TEST_ASSERT_EQUAL(3000, minLevel[0]);
+    TEST_ASSERT_EQUAL(3100, minLevel[1]);
+    TEST_ASSERT_EQUAL(500, maxLevel[0]);
+
+    // Moved to the new keys at the end of the wake
+    TEST_ASSERT_TRUE(settingsUrgent);
+    sleep();
+    TEST_ASSERT_FALSE(preferences.isKey("minLevel-"));
+    TEST_ASSERT_FALSE(preferences.isKey("inLevel-"));
+    TEST_ASSERT_FALSE(preferences.isKey("maxLevel-"));
+    TEST_ASSERT_EQUAL(3100, preferences.getInt("minLevel-1"));
+
+    // Nothing left to migrate on the next cold boot
+    loadSettings(preferences);
+    TEST_ASSERT_EQUAL(3100, minLevel[1]);
+    TEST_ASSERT_EQUAL(0, settingsDirty & ~(1ULL << SETTING_RUN));
+}
+
+void test_run_counter_not_reused_after_power_loss()
+{
+    for (uint32_t i = 0; i < 3 * RUN_CHECKPOINT_INTERVAL + 7; i++)
+    {
+        sleep();
+    }
+    uint32_t lastRun = run;
+
+    // Cold boot: the RTC memory is lost
+    run = 0;
+    Preferences preferences;
+    preferences.begin(SETTINGS_NAMESPACE);
+    loadSettings(preferences);
+    TEST_ASSERT_GREATER_THAN(lastRun, run);
+    TEST_ASSERT_LESS_OR_EQUAL(lastRun + RUN_CHECKPOINT_INTERVAL, run);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_find_setting_by_name);
+    RUN_TEST(test_find_probe_setting);
+    RUN_TEST(test_apply_setting_in_range);
+    RUN_TEST(test_apply_setting_out_of_range);
+    RUN_TEST(test_apply_setting_scale);
+    RUN_TEST(test_apply_setting_calls_on_change);
+    RUN_TEST(test_log_level_lowered_to_the_outputs);
+    RUN_TEST(test_run_counter_written_at_checkpoints);
+    RUN_TEST(test_calibration_changes_grouped);
+    RUN_TEST(test_config_change_written_at_once);
+    RUN_TEST(test_legacy_keys_migrated_once);
+    RUN_TEST(test_run_counter_not_reused_after_power_loss);
+    return UNITY_END();
+}
@@ -0,0 +1,147 @@
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include "main_globals.h"
+#include "telemetry.cpp"
+#include "batch.cpp"
+#include "topics.cpp"
+
+// The state of a wake: probe 1 below the empty level
+static const long  levels[PROBE_COUNT] = {1100, 1600};
+static const float voltage = 3.75;
+static const int8_t rssi = -67;
+
+void setUp()
+{
+    run = 1234;
+    failedConnection = 2;
+    readingCount = 3;
+    minLevel[0] = 2000;
+    maxLevel[0] = 200;
+    minLevel[1] = 1500;
+    maxLevel[1] = 300;
+    waterConfidence[0] = 80;
+    waterConfidence[1] = 65;
+    client.messages.clear();
+}
+
+void tearDown() {}
+
+static std::string published()
+{
+    std::vector<std::string> payloads = client.payloads(getTopic(TOPIC_STATE));
+    TEST_ASSERT_EQUAL(1, payloads.size());
+    TEST_ASSERT_TRUE(client.messages[0].retained);
+    return payloads[0];
+}
+
+void test_json_state()
+{
+    telemetryFormat = TELEMETRY_JSON;
+    TEST_ASSERT_TRUE(telemetryPublish(levels, voltage, rssi));
+
+    std::string state = published();
+    TEST_ASSERT_EQUAL(88, state.size());
+    TEST_ASSERT_EQUAL_STRING("{\"run\":1234,\"mv\":3750,\"rssi\":-67,\"fail\":2,\"buf\":3,\"p\":[[1100,50.00,80],[1600,-8.33,65]]}",
+                             state.c_str());
+}
+
+void test_json_invalid_level_is_null()
+{
+    const long outOfRange[PROBE_COUNT] = {1100, FARTHEST + 1};
+    TEST_ASSERT_EQUAL(77, serializeTelemetry(TELEMETRY_JSON, outOfRange, voltage, rssi));
+    TEST_ASSERT_EQUAL_STRING("{\"run\":1234,\"mv\":3750,\"rssi\":-67,\"fail\":2,\"buf\":3,\"p\":[[1100,50.00,80],null]}",
+                             (const char *)telemetryMsg);
+}
+
+// Reads the binary state field by field, as a client of the documented layout would
+static uint32_t readLittleEndian(const std::string &data, size_t &offset, size_t size)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        value |= (uint32_t)(uint8_t)data[offset + i] << (8 * i);
+    }
+    offset += size;
+    return value;
+}
+
+void test_binary_state_round_trip()
+{
+    telemetryFormat = TELEMETRY_BINARY;
+    TEST_ASSERT_TRUE(telemetryPublish(levels, voltage, rssi));
+
+    std::string state = published();
+    TEST_ASSERT_EQUAL(12, sizeof(TelemetryHeader));
+    TEST_ASSERT_EQUAL(5, sizeof(TelemetryProbe));
+    TEST_ASSERT_EQUAL(12 + PROBE_COUNT * 5, state.size());
+
+    size_t offset = 0;
+    TEST_ASSERT_EQUAL(TELEMETRY_VERSION, readLittleEndian(state, offset, 1));
+    TEST_ASSERT_EQUAL(PROBE_COUNT, readLittleEndian(state, offset, 1));
+    TEST_ASSERT_EQUAL(3750, readLittleEndian(state, offset, 2));
+    TEST_ASSERT_EQUAL(rssi, (int8_t)readLittleEndian(state, offset, 1));
+    TEST_ASSERT_EQUAL(2, readLittleEndian(state, offset, 1));
+    TEST_ASSERT_EQUAL(1234, readLittleEndian(state, offset, 4));
+    TEST_ASSERT_EQUAL(3, readLittleEndian(state, offset, 2));
+
+    const int16_t percentages[PROBE_COUNT] = {5000, -833};
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL(levels[i], readLittleEndian(state, offset, 2));
+        TEST_ASSERT_EQUAL(percentages[i], (int16_t)readLittleEndian(state, offset, 2));
+        TEST_ASSERT_EQUAL(waterConfidence[i], readLittleEndian(state, offset, 1));
+    }
+    TEST_ASSERT_EQUAL(state.size(), offset);
+}
+
+void test_binary_invalid_level_is_zero()
+{
+    const long outOfRange[PROBE_COUNT] = {CLOSEST - 1, 1600};
+    serializeTelemetry(TELEMETRY_BINARY, outOfRange, voltage, rssi);
+
+    TelemetryProbe *probes = (TelemetryProbe *)&telemetryMsg[sizeof(TelemetryHeader)];
+    TEST_ASSERT_EQUAL(0, probes[0].level);
+    TEST_ASSERT_EQUAL(0, probes[0].percentage);
+    TEST_ASSERT_EQUAL(1600, probes[1].level);
+}
+
+/*************\
+ * Benchmark *
+\*************/
+
+#define BENCHMARK_STATES 100000
+
+void test_serialization_cost()
+{
+    const uint8_t formats[] = {TELEMETRY_JSON, TELEMETRY_BINARY};
+    for (uint8_t format : formats)
+    {
+        size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BENCHMARK_STATES; i++)
+        {
+            run = i;
+            bytes = serializeTelemetry(format, levels, voltage, rssi);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        char message[80];
+        snprintf(message, sizeof(message), "%s: %zu bytes, %.0f ns per state",
+                 format == TELEMETRY_JSON ? "JSON" : "binary", bytes, elapsed.count() / BENCHMARK_STATES);
+        TEST_MESSAGE(message);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    initTopics();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_json_state);
+    RUN_TEST(test_json_invalid_level_is_null);
+    RUN_TEST(test_binary_state_round_trip);
+    RUN_TEST(test_binary_invalid_level_is_zero);
+    RUN_TEST(test_serialization_cost);
+    return UNITY_END();
+}
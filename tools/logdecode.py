@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""Rebuilds the text of a binary log (firmware built with -DLOG_FORMAT_BINARY=1).
+
+The format strings are read from the ELF of the same build
+(.pio/build/<env>/firmware.elf). The text lines of the log (ESP-IDF messages)
+are copied as they are.
+
+usage: logdecode.py firmware.elf [log file, default stdin] [--levels]
+"""
+
+import struct
+import sys
+
+ESCAPE = 0x1B
+TEXT = 0
+WAKE = 1
+LEVELS = ["S", "F", "E", "W", "N", "T", "V"]
+
+
+class Elf:
+    """Allocated sections of an ELF file, enough to read the strings in flash."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError(path + " is not an ELF file")
+        is64 = self.data[4] == 2
+        endian = "<" if self.data[5] == 1 else ">"
+
+        if is64:
+            shoff, = struct.unpack_from(endian + "Q", self.data, 0x28)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x3A)
+            section = endian + "IIQQQQIIQQ"
+        else:
+            shoff, = struct.unpack_from(endian + "I", self.data, 0x20)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x2E)
+            section = endian + "IIIIIIIIII"
+
+        self.sections = []
+        for i in range(shnum):
+            _, kind, flags, addr, offset, size = struct.unpack_from(section, self.data, shoff + i * shentsize)[:6]
+            # Allocated and with content in the file (not .bss)
+            if flags & 0x2 and kind != 8 and size > 0:
+                self.sections.append((addr, offset, size))
+
+    def string(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.index(b"\0", start, offset + size)
+                return self.data[start:end].decode("utf-8", "replace")
+        return None
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def byte(self):
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def varint(self):
+        value = shift = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if b < 0x80:
+                return value
+
+    def value(self):
+        tag = chr(self.byte())
+        if tag == "i":
+            raw = self.varint()
+            return (raw >> 1) ^ -(raw & 1)
+        if tag == "u":
+            return self.varint()
+        if tag == "f":
+            value, = struct.unpack_from("<f", self.data, self.pos)
+            self.pos += 4
+            return value
+        if tag == "s":
+            size = self.varint()
+            value = self.data[self.pos:self.pos + size].decode("utf-8", "replace")
+            self.pos += size
+            return value
+        raise ValueError("unknown tag " + tag)
+
+    def values(self):
+        values = []
+        while self.pos < len(self.data):
+            values.append(self.value())
+        return values
+
+
+def unescape(frame):
+    out = bytearray()
+    escaped = False
+    for b in frame:
+        if escaped:
+            out.append(b ^ 0x20)
+            escaped = False
+        elif b == ESCAPE:
+            escaped = True
+        else:
+            out.append(b)
+    return bytes(out)
+
+
+def number(value, base, prefix=""):
+    if isinstance(value, str):
+        return value
+    value = int(value)
+    if value < 0:
+        value &= 0xFFFFFFFF
+    digits = {16: "%X" % value, 2: bin(value)[2:]}[base]
+    return prefix + digits
+
+
+def format_arduinolog(fmt, args):
+    """Same conversions as ArduinoLog's printFormat()."""
+    out = []
+    args = list(args)
+    i = 0
+    while i < len(fmt):
+        c = fmt[i]
+        if c != "%" or i + 1 >= len(fmt):
+            out.append(c)
+            i += 1
+            continue
+        spec = fmt[i + 1]
+        i += 2
+        if spec == "%":
+            out.append("%")
+            continue
+        if not args:
+            out.append("?")
+            continue
+        value = args.pop(0)
+        if spec in "sSp":
+            out.append(str(value))
+        elif spec in "dilu":
+            out.append(str(int(value)) if not isinstance(value, str) else value)
+        elif spec in "DF":
+            out.append("%.2f" % value if not isinstance(value, str) else value)
+        elif spec == "x":
+            out.append(number(value, 16))
+        elif spec == "X":
+            out.append(number(value, 16, "0x"))
+        elif spec == "b":
+            out.append(number(value, 2))
+        elif spec == "B":
+            out.append(number(value, 2, "0b"))
+        elif spec == "c":
+            out.append(chr(value) if isinstance(value, int) else str(value))
+        elif spec == "t":
+            out.append("T" if value else "F")
+        elif spec == "T":
+            out.append("true" if value else "false")
+        else:
+            out.append("%" + spec)
+    return "".join(out)
+
+
+class Decoder:
+    def __init__(self, elf, levels=False):
+        self.elf = elf
+        self.levels = levels
+        self.run = 0
+        self.time = 0           # ms since the boot
+
+    def timestamp(self):
+        # Same prefix as printTimestamp()
+        return "%05d-%02d.%03d " % (self.run, self.time // 1000 % 100, self.time % 1000)
+
+    def record(self, frame):
+        reader = Reader(unescape(frame))
+        level = reader.byte()
+        fmt_id, = struct.unpack_from("<I", reader.data, reader.pos)
+        reader.pos += 4
+        delta = reader.varint()
+        args = reader.values()
+
+        if fmt_id == WAKE:
+            self.run = args[0] if args else 0
+            self.time = delta
+            return None
+
+        self.time += delta
+        if fmt_id == TEXT:
+            fmt = args.pop(0) if args else ""
+        else:
+            fmt = self.elf.string(fmt_id)
+            if fmt is None:
+                fmt = "<unknown format 0x%08x> %s" % (fmt_id, " ".join("%s" for _ in args))
+
+        prefix = self.timestamp()
+        if self.levels and 0 <= level < len(LEVELS):
+            prefix += LEVELS[level] + " "
+        return prefix + format_arduinolog(fmt, args)
+
+    def decode(self, data):
+        """Yields the text lines, binary frames start with a 0 byte."""
+        for line in data.split(b"\n"):
+            if line.startswith(b"\0"):
+                try:
+                    text = self.record(line[1:])
+                except (IndexError, ValueError, struct.error):
+                    text = "<corrupted record %s>" % line[1:].hex()
+                if text is not None:
+                    yield text
+            elif line:
+                yield line.decode("utf-8", "replace").rstrip("\r")
+
+
+def main(argv):
+    args = [a for a in argv[1:] if not a.startswith("--")]
+    if not args:
+        print(__doc__.strip(), file=sys.stderr)
+        return 1
+
+    decoder = Decoder(Elf(args[0]), "--levels" in argv)
+    if len(args) > 1 and args[1] != "-":
+        with open(args[1], "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    for line in decoder.decode(data):
+        print(line)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))